@@ -0,0 +1,112 @@
+#include "Benchmark.h"
+#include "Renderer.h"
+#include "GpuProfiler.h"
+#include "ScreenCapture.h"
+#include "PresentationEngine.h"
+#include <chrono>
+#include <cmath>
+#include <fstream>
+
+Benchmark::Benchmark(Renderer& renderer, uint32_t warmupFrames, uint32_t measuredFrames, const std::string& outputPath)
+    : m_renderer{renderer}, warmupFrames{warmupFrames}, measuredFrames{measuredFrames}, outputPath{outputPath} {
+    cpuFrameMs.reserve(measuredFrames);
+    gpuFrameMs.reserve(measuredFrames);
+}
+
+void Benchmark::run() {
+    // the warm-up fills every frame in flight, the staging ring and the
+    // pipeline caches of the driver before anything is timed
+    for (uint32_t frame{}; frame < warmupFrames; frame++)
+        m_renderer.drawHeadlessFrame();
+
+    auto& profiler = m_renderer.pGpuProfiler;
+    bool gpuTimed{profiler && profiler->isSupported()};
+    uint64_t resolvedFrames{gpuTimed ? profiler->getResolvedFrames() : 0};
+    auto startTime = std::chrono::steady_clock::now();
+    auto frameStart = startTime;
+    for (uint32_t frame{}; frame < measuredFrames; frame++) {
+        m_renderer.drawHeadlessFrame();
+        auto frameEnd = std::chrono::steady_clock::now();
+        cpuFrameMs.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+        frameStart = frameEnd;
+        // the timestamps come back framesInFlight frames late, the first few
+        // samples belong to the warm-up which is as long as the pipeline is full,
+        // a frame that resolved nothing new would only repeat the last sample
+        if (gpuTimed && profiler->getResolvedFrames() != resolvedFrames) {
+            resolvedFrames = profiler->getResolvedFrames();
+            gpuFrameMs.push_back(profiler->getLastFrameMs());
+        }
+    }
+    m_renderer.m_device.waitIdle();
+    totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    m_renderer.pCapture->flush();
+
+    writeJson(std::cout);
+    if (outputPath.empty())
+        return;
+    std::ofstream file{outputPath, std::ios::trunc};
+    if (!file.is_open()) {
+        std::cout << "failed to open benchmark output " << outputPath << "\n";
+        return;
+    }
+    writeJson(file);
+    std::cout << "benchmark results written to " << outputPath << "\n";
+}
+
+Benchmark::Summary Benchmark::summarize(std::vector<double> samples) {
+    Summary summary{};
+    summary.samples = samples.size();
+    if (samples.empty())
+        return summary;
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {
+        size_t rank{static_cast<size_t>(std::ceil(p * samples.size()))};
+        return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+    };
+    double sum{};
+    for (double sample : samples)
+        sum += sample;
+    summary.mean = sum / samples.size();
+    summary.p50 = percentile(0.50);
+    summary.p95 = percentile(0.95);
+    summary.p99 = percentile(0.99);
+    return summary;
+}
+
+void Benchmark::writeSummary(std::ostream& out, const Summary& summary) {
+    out << "{\"mean\": " << summary.mean << ", \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95
+        << ", \"p99\": " << summary.p99 << ", \"samples\": " << summary.samples << "}";
+}
+
+void Benchmark::writeJson(std::ostream& out) const {
+    auto cpu = summarize(cpuFrameMs);
+    // fps is taken from the frame time percentiles, so its p99 is the rate of
+    // the slowest one percent of the frames and not the fastest
+    Summary fps{};
+    fps.samples = cpu.samples;
+    if (cpu.samples > 0) {
+        fps.mean = measuredFrames / totalSeconds;
+        fps.p50 = 1000.0 / cpu.p50;
+        fps.p95 = 1000.0 / cpu.p95;
+        fps.p99 = 1000.0 / cpu.p99;
+    }
+    auto extent = m_renderer.pEngine->swapChainExtent;
+    out << "{\n  \"device\": \"" << m_renderer.m_physicalDevice.getProperties().deviceName.data() << "\",\n"
+        << "  \"config\": {\"width\": " << extent.width << ", \"height\": " << extent.height
+        << ", \"instances\": " << m_renderer.instanceCount << ", \"frames_in_flight\": " << m_renderer.framesInFlight
+        << ", \"warmup_frames\": " << warmupFrames << ", \"measured_frames\": " << measuredFrames
+        << ", \"gpu_culling\": " << (m_renderer.gpuCulling ? "true" : "false")
+        << ", \"cpu_culling\": " << (m_renderer.cpuCulling ? "true" : "false")
+        << ", \"record_threads\": " << m_renderer.recordThreads << "},\n"
+        << "  \"total_seconds\": " << totalSeconds << ",\n  \"cpu_frame_ms\": ";
+    writeSummary(out, cpu);
+    out << ",\n  \"gpu_frame_ms\": ";
+    // without timestamp support there is nothing to report
+    if (gpuFrameMs.empty())
+        out << "null";
+    else
+        writeSummary(out, summarize(gpuFrameMs));
+    out << ",\n  \"fps\": ";
+    writeSummary(out, fps);
+    out << "\n}\n";
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "commonIncludes.h"
+
+class Renderer;
+// drives the headless renderer through a fixed number of warm-up frames and
+// then times the measured ones, the camera follows Renderer::updateCamera's
+// scripted path so two runs of the same build render the same frames
+class Benchmark {
+  public:
+    struct Summary {
+        double mean{};
+        double p50{};
+        double p95{};
+        double p99{};
+        size_t samples{};
+    };
+
+    Benchmark(Renderer& renderer, uint32_t warmupFrames, uint32_t measuredFrames, const std::string& outputPath = {});
+    Benchmark(const Benchmark&) = delete;
+    Benchmark& operator=(const Benchmark&) = delete;
+
+    void run();
+    // nearest rank percentiles of the samples
+    static Summary summarize(std::vector<double> samples);
+
+  private:
+    Renderer& m_renderer;
+    uint32_t warmupFrames{};
+    uint32_t measuredFrames{};
+    std::string outputPath{};
+    std::vector<double> cpuFrameMs{};
+    std::vector<double> gpuFrameMs{};
+    double totalSeconds{};
+
+    void writeJson(std::ostream& out) const;
+    static void writeSummary(std::ostream& out, const Summary& summary);
+};
@@ -0,0 +1,486 @@
+#include "CompressedTexture.h"
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+uint32_t readU32(const std::vector<unsigned char>& file, size_t offset) {
+    if (offset + 4 > file.size())
+        throw std::runtime_error("texture file is truncated");
+    return file[offset] | file[offset + 1] << 8 | file[offset + 2] << 16 | static_cast<uint32_t>(file[offset + 3]) << 24;
+}
+
+uint64_t readU64(const std::vector<unsigned char>& file, size_t offset) {
+    return readU32(file, offset) | static_cast<uint64_t>(readU32(file, offset + 4)) << 32;
+}
+
+constexpr uint32_t makeFourCC(char a, char b, char c, char d) {
+    return static_cast<uint32_t>(a) | static_cast<uint32_t>(b) << 8 | static_cast<uint32_t>(c) << 16 | static_cast<uint32_t>(d) << 24;
+}
+
+// reads the 128 bit blocks least significant bit first
+struct BitReader {
+    const unsigned char* block{nullptr};
+    uint32_t position{};
+
+    uint32_t read(uint32_t count) {
+        uint32_t value{};
+        for (uint32_t bit{}; bit < count; bit++, position++)
+            value |= ((block[position >> 3] >> (position & 7)) & 1u) << bit;
+        return value;
+    }
+};
+
+void decodeColorBlock(const unsigned char* block, unsigned char* rgba, bool allowTransparent) {
+    uint32_t color0{static_cast<uint32_t>(block[0] | block[1] << 8)};
+    uint32_t color1{static_cast<uint32_t>(block[2] | block[3] << 8)};
+    std::array<std::array<uint32_t, 4>, 4> colors{};
+    for (int index{}; index < 2; index++) {
+        uint32_t color{index == 0 ? color0 : color1};
+        uint32_t red{(color >> 11) & 31};
+        uint32_t green{(color >> 5) & 63};
+        uint32_t blue{color & 31};
+        colors[index] = {red << 3 | red >> 2, green << 2 | green >> 4, blue << 3 | blue >> 2, 255};
+    }
+
+    if (color0 > color1 || !allowTransparent) {
+        for (int channel{}; channel < 3; channel++) {
+            colors[2][channel] = (2 * colors[0][channel] + colors[1][channel]) / 3;
+            colors[3][channel] = (colors[0][channel] + 2 * colors[1][channel]) / 3;
+        }
+        colors[2][3] = 255;
+        colors[3][3] = 255;
+    } else {
+        for (int channel{}; channel < 3; channel++)
+            colors[2][channel] = (colors[0][channel] + colors[1][channel]) / 2;
+        colors[2][3] = 255;
+        colors[3] = {0, 0, 0, 0};
+    }
+
+    uint32_t indices{block[4] | block[5] << 8 | block[6] << 16 | static_cast<uint32_t>(block[7]) << 24};
+    for (int pixel{}; pixel < 16; pixel++) {
+        const auto& color = colors[(indices >> (pixel * 2)) & 3];
+        for (int channel{}; channel < 4; channel++)
+            rgba[pixel * 4 + channel] = static_cast<unsigned char>(color[channel]);
+    }
+}
+
+void decodeAlphaBlock(const unsigned char* block, unsigned char* rgba) {
+    std::array<uint32_t, 8> alphas{block[0], block[1]};
+    if (alphas[0] > alphas[1]) {
+        for (uint32_t index{1}; index < 7; index++)
+            alphas[index + 1] = ((7 - index) * alphas[0] + index * alphas[1] + 3) / 7;
+    } else {
+        for (uint32_t index{1}; index < 5; index++)
+            alphas[index + 1] = ((5 - index) * alphas[0] + index * alphas[1] + 2) / 5;
+        alphas[6] = 0;
+        alphas[7] = 255;
+    }
+
+    uint64_t indices{};
+    for (int index{}; index < 6; index++)
+        indices |= static_cast<uint64_t>(block[2 + index]) << (index * 8);
+    for (int pixel{}; pixel < 16; pixel++)
+        rgba[pixel * 4 + 3] = static_cast<unsigned char>(alphas[(indices >> (pixel * 3)) & 7]);
+}
+
+struct BC7Mode {
+    uint32_t subsets{};
+    uint32_t partitionBits{};
+    uint32_t rotationBits{};
+    uint32_t indexSelectionBits{};
+    uint32_t colorBits{};
+    uint32_t alphaBits{};
+    uint32_t endpointPBits{};
+    uint32_t sharedPBits{};
+    uint32_t indexBits{};
+    uint32_t index2Bits{};
+};
+
+constexpr std::array<BC7Mode, 8> bc7Modes{{
+    {3, 4, 0, 0, 4, 0, 1, 0, 3, 0},
+    {2, 6, 0, 0, 6, 0, 0, 1, 3, 0},
+    {3, 6, 0, 0, 5, 0, 0, 0, 2, 0},
+    {2, 6, 0, 0, 7, 0, 1, 0, 2, 0},
+    {1, 0, 2, 1, 5, 6, 0, 0, 2, 3},
+    {1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
+    {1, 0, 0, 0, 7, 7, 1, 0, 4, 0},
+    {2, 6, 0, 0, 5, 5, 1, 0, 2, 0},
+}};
+
+// bit n is the subset of pixel n
+constexpr std::array<uint16_t, 64> bc7Partitions2{
+    0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+    0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+    0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+    0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+    0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+    0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+    0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+    0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22};
+
+// two bits per pixel
+constexpr std::array<uint32_t, 64> bc7Partitions3{
+    0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+    0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+    0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+    0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+    0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+    0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+    0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+    0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254};
+
+// the anchor pixels store their index with one bit less
+constexpr std::array<uint8_t, 64> bc7Anchors2{
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+    15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+    6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15};
+
+constexpr std::array<uint8_t, 64> bc7Anchors3Second{
+    3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+    3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+    8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+    3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3};
+
+constexpr std::array<uint8_t, 64> bc7Anchors3Third{
+    15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+    15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+    15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+    15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8};
+
+constexpr std::array<uint32_t, 4> bc7Weights2{0, 21, 43, 64};
+constexpr std::array<uint32_t, 8> bc7Weights3{0, 9, 18, 27, 37, 46, 55, 64};
+constexpr std::array<uint32_t, 16> bc7Weights4{0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+uint32_t bc7Interpolate(uint32_t first, uint32_t second, uint32_t index, uint32_t indexBits) {
+    uint32_t weight{indexBits == 2 ? bc7Weights2[index] : indexBits == 3 ? bc7Weights3[index] : bc7Weights4[index]};
+    return ((64 - weight) * first + weight * second + 32) >> 6;
+}
+
+uint32_t bc7Expand(uint32_t value, uint32_t precision) {
+    value <<= 8 - precision;
+    return value | value >> precision;
+}
+
+void decodeBC7Block(const unsigned char* block, unsigned char* rgba) {
+    uint32_t modeIndex{};
+    while (modeIndex < 8 && !(block[0] & (1u << modeIndex)))
+        modeIndex++;
+    // reserved mode, the spec says to decode it as transparent black
+    if (modeIndex == 8) {
+        std::memset(rgba, 0, 64);
+        return;
+    }
+
+    const auto& mode = bc7Modes[modeIndex];
+    BitReader bits{block, modeIndex + 1};
+    uint32_t partition{bits.read(mode.partitionBits)};
+    uint32_t rotation{bits.read(mode.rotationBits)};
+    uint32_t indexSelection{bits.read(mode.indexSelectionBits)};
+
+    // [subset][endpoint][channel]
+    uint32_t endpoints[3][2][4]{};
+    for (uint32_t channel{}; channel < 3; channel++) {
+        for (uint32_t subset{}; subset < mode.subsets; subset++) {
+            endpoints[subset][0][channel] = bits.read(mode.colorBits);
+            endpoints[subset][1][channel] = bits.read(mode.colorBits);
+        }
+    }
+    if (mode.alphaBits) {
+        for (uint32_t subset{}; subset < mode.subsets; subset++) {
+            endpoints[subset][0][3] = bits.read(mode.alphaBits);
+            endpoints[subset][1][3] = bits.read(mode.alphaBits);
+        }
+    }
+
+    uint32_t colorPrecision{mode.colorBits};
+    uint32_t alphaPrecision{mode.alphaBits};
+    if (mode.endpointPBits || mode.sharedPBits) {
+        for (uint32_t subset{}; subset < mode.subsets; subset++) {
+            uint32_t pBit{bits.read(1)};
+            for (uint32_t endpoint{}; endpoint < 2; endpoint++) {
+                if (endpoint == 1 && mode.endpointPBits)
+                    pBit = bits.read(1);
+                for (uint32_t channel{}; channel < 4; channel++)
+                    endpoints[subset][endpoint][channel] = endpoints[subset][endpoint][channel] << 1 | pBit;
+            }
+        }
+        colorPrecision++;
+        if (alphaPrecision)
+            alphaPrecision++;
+    }
+    for (uint32_t subset{}; subset < mode.subsets; subset++) {
+        for (uint32_t endpoint{}; endpoint < 2; endpoint++) {
+            auto& values = endpoints[subset][endpoint];
+            for (uint32_t channel{}; channel < 3; channel++)
+                values[channel] = bc7Expand(values[channel], colorPrecision);
+            values[3] = alphaPrecision ? bc7Expand(values[3], alphaPrecision) : 255;
+        }
+    }
+
+    const auto subsetOf = [&](uint32_t pixel) -> uint32_t {
+        if (mode.subsets == 2)
+            return (bc7Partitions2[partition] >> pixel) & 1;
+        if (mode.subsets == 3)
+            return (bc7Partitions3[partition] >> (pixel * 2)) & 3;
+        return 0;
+    };
+    const auto isAnchor = [&](uint32_t pixel) {
+        if (pixel == 0)
+            return true;
+        if (mode.subsets == 2)
+            return pixel == bc7Anchors2[partition];
+        if (mode.subsets == 3)
+            return pixel == bc7Anchors3Second[partition] || pixel == bc7Anchors3Third[partition];
+        return false;
+    };
+
+    std::array<uint32_t, 16> indices{};
+    std::array<uint32_t, 16> indices2{};
+    for (uint32_t pixel{}; pixel < 16; pixel++)
+        indices[pixel] = bits.read(mode.indexBits - (isAnchor(pixel) ? 1 : 0));
+    if (mode.index2Bits) {
+        for (uint32_t pixel{}; pixel < 16; pixel++)
+            indices2[pixel] = bits.read(mode.index2Bits - (pixel == 0 ? 1 : 0));
+    }
+
+    for (uint32_t pixel{}; pixel < 16; pixel++) {
+        const auto& first = endpoints[subsetOf(pixel)][0];
+        const auto& second = endpoints[subsetOf(pixel)][1];
+        uint32_t colorIndex{indices[pixel]};
+        uint32_t colorIndexBits{mode.indexBits};
+        uint32_t alphaIndex{indices[pixel]};
+        uint32_t alphaIndexBits{mode.indexBits};
+        // modes 4 and 5 keep separate indices for color and alpha
+        if (mode.index2Bits) {
+            if (indexSelection) {
+                colorIndex = indices2[pixel];
+                colorIndexBits = mode.index2Bits;
+            } else {
+                alphaIndex = indices2[pixel];
+                alphaIndexBits = mode.index2Bits;
+            }
+        }
+
+        unsigned char* out{rgba + pixel * 4};
+        for (uint32_t channel{}; channel < 3; channel++)
+            out[channel] = static_cast<unsigned char>(bc7Interpolate(first[channel], second[channel], colorIndex, colorIndexBits));
+        out[3] = static_cast<unsigned char>(bc7Interpolate(first[3], second[3], alphaIndex, alphaIndexBits));
+        if (rotation)
+            std::swap(out[3], out[rotation - 1]);
+    }
+}
+} // namespace
+
+bool CompressedTexture::isCompressedFile(const std::string& fileName) {
+    auto extension = std::filesystem::path{fileName}.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension == ".ktx2" || extension == ".dds";
+}
+
+CompressedTexture CompressedTexture::load(const std::string& fileName) {
+    std::ifstream file{fileName, std::ios::ate | std::ios::binary};
+    if (!file.is_open())
+        throw std::runtime_error("failed to open texture " + fileName);
+
+    std::vector<unsigned char> contents(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(contents.data()), contents.size());
+    if (!file)
+        throw std::runtime_error("failed to read texture " + fileName);
+
+    const std::array<unsigned char, 12> ktx2Identifier{0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+    if (contents.size() >= ktx2Identifier.size() && std::equal(ktx2Identifier.begin(), ktx2Identifier.end(), contents.begin()))
+        return loadKTX2(std::move(contents));
+    if (contents.size() >= 4 && readU32(contents, 0) == makeFourCC('D', 'D', 'S', ' '))
+        return loadDDS(std::move(contents));
+    throw std::runtime_error(fileName + " is neither a KTX2 nor a DDS file");
+}
+
+CompressedTexture CompressedTexture::loadDDS(std::vector<unsigned char> file) {
+    // "DDS " followed by the 124 byte DDS_HEADER and an optional DDS_HEADER_DXT10
+    CompressedTexture texture{};
+    uint32_t flags{readU32(file, 8)};
+    texture.height = readU32(file, 12);
+    texture.width = readU32(file, 16);
+    const uint32_t mipMapCountFlag{0x20000};
+    uint32_t levelCount{flags & mipMapCountFlag ? std::max(readU32(file, 28), 1u) : 1u};
+    uint32_t fourCC{readU32(file, 84)};
+    const uint32_t cubeMapCaps{0x200};
+    if (readU32(file, 112) & cubeMapCaps)
+        throw std::runtime_error("dds cube maps are not supported");
+
+    size_t dataOffset{128};
+    if (fourCC == makeFourCC('D', 'X', '1', '0')) {
+        uint32_t dxgiFormat{readU32(file, 128)};
+        const uint32_t texture2D{3};
+        const uint32_t cubeMapFlag{0x4};
+        if (readU32(file, 132) != texture2D || readU32(file, 136) & cubeMapFlag || readU32(file, 140) > 1)
+            throw std::runtime_error("only single 2d dds textures are supported");
+        switch (dxgiFormat) {
+        case 71: // DXGI_FORMAT_BC1_UNORM
+        case 72: // DXGI_FORMAT_BC1_UNORM_SRGB
+            texture.compression = Compression::BC1;
+            break;
+        case 77: // DXGI_FORMAT_BC3_UNORM
+        case 78: // DXGI_FORMAT_BC3_UNORM_SRGB
+            texture.compression = Compression::BC3;
+            break;
+        case 98: // DXGI_FORMAT_BC7_UNORM
+        case 99: // DXGI_FORMAT_BC7_UNORM_SRGB
+            texture.compression = Compression::BC7;
+            break;
+        default:
+            throw std::runtime_error("unsupported dds dxgi format " + std::to_string(dxgiFormat));
+        }
+        texture.srgb = dxgiFormat == 72 || dxgiFormat == 78 || dxgiFormat == 99;
+        dataOffset += 20;
+    } else if (fourCC == makeFourCC('D', 'X', 'T', '1')) {
+        // legacy headers carry no color space, every texture here is color data
+        texture.compression = Compression::BC1;
+    } else if (fourCC == makeFourCC('D', 'X', 'T', '5')) {
+        texture.compression = Compression::BC3;
+    } else {
+        throw std::runtime_error("unsupported dds pixel format");
+    }
+
+    texture.data = std::move(file);
+    texture.addLevels(levelCount, dataOffset);
+    return texture;
+}
+
+CompressedTexture CompressedTexture::loadKTX2(std::vector<unsigned char> file) {
+    CompressedTexture texture{};
+    uint32_t vkFormat{readU32(file, 12)};
+    texture.width = readU32(file, 20);
+    texture.height = readU32(file, 24);
+    uint32_t depth{readU32(file, 28)};
+    uint32_t layerCount{readU32(file, 32)};
+    uint32_t faceCount{readU32(file, 36)};
+    // 0 asks the loader to generate mips, block formats can't be blit so only the base is used
+    uint32_t levelCount{std::max(readU32(file, 40), 1u)};
+    uint32_t supercompression{readU32(file, 44)};
+    if (depth > 1 || layerCount > 1 || faceCount != 1)
+        throw std::runtime_error("only single 2d ktx2 textures are supported");
+    if (supercompression != 0)
+        throw std::runtime_error("supercompressed ktx2 files are not supported");
+
+    switch (static_cast<vk::Format>(vkFormat)) {
+    case vk::Format::eBc1RgbUnormBlock:
+    case vk::Format::eBc1RgbSrgbBlock:
+        texture.hasAlpha = false;
+        [[fallthrough]];
+    case vk::Format::eBc1RgbaUnormBlock:
+    case vk::Format::eBc1RgbaSrgbBlock:
+        texture.compression = Compression::BC1;
+        break;
+    case vk::Format::eBc3UnormBlock:
+    case vk::Format::eBc3SrgbBlock:
+        texture.compression = Compression::BC3;
+        break;
+    case vk::Format::eBc7UnormBlock:
+    case vk::Format::eBc7SrgbBlock:
+        texture.compression = Compression::BC7;
+        break;
+    default:
+        throw std::runtime_error("unsupported ktx2 vkFormat " + std::to_string(vkFormat));
+    }
+    auto format = static_cast<vk::Format>(vkFormat);
+    texture.srgb = format == vk::Format::eBc1RgbSrgbBlock || format == vk::Format::eBc1RgbaSrgbBlock || format == vk::Format::eBc3SrgbBlock || format == vk::Format::eBc7SrgbBlock;
+
+    // the level index follows the 80 byte header, 24 bytes per level
+    const size_t levelIndexOffset{80};
+    for (uint32_t index{}; index < levelCount; index++) {
+        Level level{};
+        level.offset = readU64(file, levelIndexOffset + index * 24);
+        level.size = readU64(file, levelIndexOffset + index * 24 + 8);
+        level.width = std::max(texture.width >> index, 1u);
+        level.height = std::max(texture.height >> index, 1u);
+        texture.levels.push_back(level);
+    }
+    texture.data = std::move(file);
+
+    for (const auto& level : texture.levels) {
+        size_t expected{((level.width + 3) / 4) * ((level.height + 3) / 4) * texture.getBlockSize()};
+        if (level.size != expected || level.offset + level.size > texture.data.size())
+            throw std::runtime_error("ktx2 level data is corrupt");
+    }
+    return texture;
+}
+
+void CompressedTexture::addLevels(uint32_t levelCount, size_t dataOffset) {
+    // dds stores the levels back to back starting with the largest
+    for (uint32_t index{}; index < levelCount; index++) {
+        Level level{};
+        level.width = std::max(width >> index, 1u);
+        level.height = std::max(height >> index, 1u);
+        level.offset = dataOffset;
+        level.size = ((level.width + 3) / 4) * ((level.height + 3) / 4) * getBlockSize();
+        if (level.offset + level.size > data.size())
+            throw std::runtime_error("dds level data is truncated");
+        dataOffset += level.size;
+        levels.push_back(level);
+    }
+}
+
+size_t CompressedTexture::getBlockSize() const {
+    return compression == Compression::BC1 ? 8 : 16;
+}
+
+vk::Format CompressedTexture::getFormat() const {
+    switch (compression) {
+    case Compression::BC1:
+        if (!hasAlpha)
+            return srgb ? vk::Format::eBc1RgbSrgbBlock : vk::Format::eBc1RgbUnormBlock;
+        return srgb ? vk::Format::eBc1RgbaSrgbBlock : vk::Format::eBc1RgbaUnormBlock;
+    case Compression::BC3:
+        return srgb ? vk::Format::eBc3SrgbBlock : vk::Format::eBc3UnormBlock;
+    case Compression::BC7:
+        return srgb ? vk::Format::eBc7SrgbBlock : vk::Format::eBc7UnormBlock;
+    }
+    return vk::Format::eUndefined;
+}
+
+vk::Format CompressedTexture::getDecompressedFormat() const {
+    return srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm;
+}
+
+void CompressedTexture::decompressBlock(const unsigned char* block, unsigned char* rgba) const {
+    switch (compression) {
+    case Compression::BC1:
+        decodeColorBlock(block, rgba, hasAlpha);
+        break;
+    case Compression::BC3:
+        decodeColorBlock(block + 8, rgba, false);
+        decodeAlphaBlock(block, rgba);
+        break;
+    case Compression::BC7:
+        decodeBC7Block(block, rgba);
+        break;
+    }
+}
+
+std::vector<unsigned char> CompressedTexture::decompress(uint32_t levelIndex) const {
+    const auto& level = levels[levelIndex];
+    std::vector<unsigned char> pixels(static_cast<size_t>(level.width) * level.height * 4);
+    const uint32_t blocksWide{(level.width + 3) / 4};
+    const uint32_t blocksHigh{(level.height + 3) / 4};
+    const unsigned char* block{data.data() + level.offset};
+    std::array<unsigned char, 64> rgba{};
+
+    for (uint32_t blockY{}; blockY < blocksHigh; blockY++) {
+        for (uint32_t blockX{}; blockX < blocksWide; blockX++, block += getBlockSize()) {
+            decompressBlock(block, rgba.data());
+            // blocks on the right and bottom edge can hang over the image
+            for (uint32_t y{}; y < 4 && blockY * 4 + y < level.height; y++) {
+                for (uint32_t x{}; x < 4 && blockX * 4 + x < level.width; x++) {
+                    size_t dst{((static_cast<size_t>(blockY) * 4 + y) * level.width + blockX * 4 + x) * 4};
+                    std::memcpy(&pixels[dst], &rgba[(y * 4 + x) * 4], 4);
+                }
+            }
+        }
+    }
+    return pixels;
+}
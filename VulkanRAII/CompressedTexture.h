@@ -0,0 +1,44 @@
+#pragma once
+#include "commonIncludes.h"
+
+// a 2d texture read from a KTX2 or DDS file with BC1, BC3 or BC7 blocks for
+// every mip level, decompress() turns a level into plain rgba8 for devices
+// that can't sample the block format directly
+class CompressedTexture {
+  public:
+    enum class Compression {
+        BC1,
+        BC3,
+        BC7
+    };
+
+    struct Level {
+        size_t offset{};
+        size_t size{};
+        uint32_t width{};
+        uint32_t height{};
+    };
+
+    Compression compression{Compression::BC1};
+    bool srgb{true};
+    // only false for BC1 files stored as rgb, their black texels stay opaque
+    bool hasAlpha{true};
+    uint32_t width{};
+    uint32_t height{};
+    // level 0 is the full size image
+    std::vector<Level> levels{};
+    std::vector<unsigned char> data{};
+
+    static CompressedTexture load(const std::string& fileName);
+    static bool isCompressedFile(const std::string& fileName);
+    vk::Format getFormat() const;
+    vk::Format getDecompressedFormat() const;
+    std::vector<unsigned char> decompress(uint32_t level) const;
+
+  private:
+    static CompressedTexture loadDDS(std::vector<unsigned char> file);
+    static CompressedTexture loadKTX2(std::vector<unsigned char> file);
+    size_t getBlockSize() const;
+    void addLevels(uint32_t levelCount, size_t dataOffset);
+    void decompressBlock(const unsigned char* block, unsigned char* rgba) const;
+};
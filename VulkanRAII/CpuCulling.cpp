@@ -0,0 +1,228 @@
+#include "CpuCulling.h"
+#include <bit>
+#include <chrono>
+#include <random>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CULLING_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// msvc emits any intrinsic without a target switch
+#define CULLING_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define CULLING_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+CpuCulling::CpuCulling(const std::vector<glm::vec3>& instances, const glm::vec4& boundingSphere)
+    : offsets{instances}
+    , path{getBestPath()} {
+    const size_t paddedCount{(instances.size() + laneCount - 1) / laneCount * laneCount};
+    // a negative radius the size of the float range fails every plane
+    centerX.assign(paddedCount, 0.0f);
+    centerY.assign(paddedCount, 0.0f);
+    centerZ.assign(paddedCount, 0.0f);
+    radius.assign(paddedCount, -std::numeric_limits<float>::max());
+    for (size_t index{}; index < instances.size(); index++) {
+        centerX[index] = instances[index].x + boundingSphere.x;
+        centerY[index] = instances[index].y + boundingSphere.y;
+        centerZ[index] = instances[index].z + boundingSphere.z;
+        radius[index] = boundingSphere.w;
+    }
+}
+
+size_t CpuCulling::cull(const std::array<glm::vec4, 6>& planes, glm::vec3* visible) const {
+    return cull(planes, visible, path);
+}
+
+size_t CpuCulling::cull(const std::array<glm::vec4, 6>& planes, glm::vec3* visible, Path cullPath) const {
+    switch (cullPath) {
+    case Path::AVX2:
+        return cullAVX2(planes, visible);
+    case Path::SSE:
+        return cullSSE(planes, visible);
+    default:
+        return cullScalar(planes, visible);
+    }
+}
+
+size_t CpuCulling::getInstanceCount() const {
+    return offsets.size();
+}
+
+CpuCulling::Path CpuCulling::getPath() const {
+    return path;
+}
+
+CpuCulling::Path CpuCulling::getBestPath() {
+#ifdef CULLING_X86
+    // avx2 also needs the os to save the ymm registers, xgetbv bits 1 and 2
+    bool avx2{false};
+#if defined(_MSC_VER)
+    int info[4]{};
+    __cpuid(info, 1);
+    bool osxsave{(info[2] & (1 << 27)) != 0};
+    bool avx{(info[2] & (1 << 28)) != 0};
+    __cpuidex(info, 7, 0);
+    avx2 = osxsave && avx && (info[1] & (1 << 5)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+#else
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2");
+#endif
+    // sse2 is part of every x86-64 cpu
+    return avx2 ? Path::AVX2 : Path::SSE;
+#else
+    return Path::Scalar;
+#endif
+}
+
+const char* CpuCulling::getPathName(Path path) {
+    switch (path) {
+    case Path::AVX2:
+        return "avx2";
+    case Path::SSE:
+        return "sse";
+    default:
+        return "scalar";
+    }
+}
+
+std::array<glm::vec4, 6> CpuCulling::getFrustumPlanes(const glm::mat4& clip) {
+    // Gribb and Hartmann, glm is column major so row i is clip[c][i], vulkan's
+    // depth range is [0, 1] which makes the near plane the third row on its own
+    auto row = [&clip](int index) {
+        return glm::vec4{clip[0][index], clip[1][index], clip[2][index], clip[3][index]};
+    };
+    std::array<glm::vec4, 6> planes{
+        row(3) + row(0),
+        row(3) - row(0),
+        row(3) + row(1),
+        row(3) - row(1),
+        row(2),
+        row(3) - row(2)};
+    for (auto& plane : planes)
+        plane /= glm::length(glm::vec3{plane});
+    return planes;
+}
+
+size_t CpuCulling::cullScalar(const std::array<glm::vec4, 6>& planes, glm::vec3* visible) const {
+    size_t visibleCount{};
+    for (size_t index{}; index < offsets.size(); index++) {
+        bool inside{true};
+        for (const auto& plane : planes) {
+            // same operation order as the simd paths so all of them agree exactly
+            float distance{plane.x * centerX[index] + plane.y * centerY[index] + plane.z * centerZ[index] + plane.w};
+            if (!(distance >= -radius[index])) {
+                inside = false;
+                break;
+            }
+        }
+        if (inside)
+            visible[visibleCount++] = offsets[index];
+    }
+    return visibleCount;
+}
+
+size_t CpuCulling::cullSSE(const std::array<glm::vec4, 6>& planes, glm::vec3* visible) const {
+#ifdef CULLING_X86
+    size_t visibleCount{};
+    for (size_t index{}; index < offsets.size(); index += 4) {
+        __m128 x{_mm_loadu_ps(&centerX[index])};
+        __m128 y{_mm_loadu_ps(&centerY[index])};
+        __m128 z{_mm_loadu_ps(&centerZ[index])};
+        __m128 negativeRadius{_mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[index]))};
+        int mask{0xF};
+        for (const auto& plane : planes) {
+            __m128 distance{_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_mul_ps(_mm_set1_ps(plane.y), y)), _mm_mul_ps(_mm_set1_ps(plane.z), z)), _mm_set1_ps(plane.w))};
+            mask &= _mm_movemask_ps(_mm_cmpge_ps(distance, negativeRadius));
+            if (mask == 0)
+                break;
+        }
+        // padding lanes always fail so every set bit is a real instance
+        while (mask != 0) {
+            int lane{std::countr_zero(static_cast<unsigned>(mask))};
+            visible[visibleCount++] = offsets[index + lane];
+            mask &= mask - 1;
+        }
+    }
+    return visibleCount;
+#else
+    return cullScalar(planes, visible);
+#endif
+}
+
+#ifdef CULLING_X86
+CULLING_TARGET_AVX2 static size_t cullAVX2Lanes(const std::array<glm::vec4, 6>& planes, const float* centerX, const float* centerY, const float* centerZ, const float* radius, const glm::vec3* offsets, size_t count, glm::vec3* visible) {
+    size_t visibleCount{};
+    for (size_t index{}; index < count; index += 8) {
+        __m256 x{_mm256_loadu_ps(centerX + index)};
+        __m256 y{_mm256_loadu_ps(centerY + index)};
+        __m256 z{_mm256_loadu_ps(centerZ + index)};
+        __m256 negativeRadius{_mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + index))};
+        int mask{0xFF};
+        for (const auto& plane : planes) {
+            __m256 distance{_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), x), _mm256_mul_ps(_mm256_set1_ps(plane.y), y)), _mm256_mul_ps(_mm256_set1_ps(plane.z), z)), _mm256_set1_ps(plane.w))};
+            mask &= _mm256_movemask_ps(_mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+            if (mask == 0)
+                break;
+        }
+        while (mask != 0) {
+            int lane{std::countr_zero(static_cast<unsigned>(mask))};
+            visible[visibleCount++] = offsets[index + lane];
+            mask &= mask - 1;
+        }
+    }
+    return visibleCount;
+}
+#endif
+
+size_t CpuCulling::cullAVX2(const std::array<glm::vec4, 6>& planes, glm::vec3* visible) const {
+#ifdef CULLING_X86
+    // the padded arrays are read eight at a time, only the offsets stop at the real count
+    return cullAVX2Lanes(planes, centerX.data(), centerY.data(), centerZ.data(), radius.data(), offsets.data(), offsets.size(), visible);
+#else
+    return cullScalar(planes, visible);
+#endif
+}
+
+void CpuCulling::runBenchmark() {
+    // a camera in the middle of a cube of instances, about one in twenty survives
+    glm::mat4 proj{glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f)};
+    proj[1][1] *= -1;
+    glm::mat4 view{glm::lookAt(glm::vec3{0.0f}, glm::vec3{0.0f, 0.0f, -1.0f}, glm::vec3{0.0f, 1.0f, 0.0f})};
+    auto planes = getFrustumPlanes(proj * view);
+
+    std::vector<Path> paths{Path::Scalar};
+    if (getBestPath() != Path::Scalar)
+        paths.push_back(Path::SSE);
+    if (getBestPath() == Path::AVX2)
+        paths.push_back(Path::AVX2);
+
+    std::mt19937 generator{1234};
+    std::uniform_real_distribution<float> distribution{-100.0f, 100.0f};
+    for (size_t instanceCount : {size_t{10'000}, size_t{100'000}, size_t{1'000'000}}) {
+        std::vector<glm::vec3> instances(instanceCount);
+        for (auto& instance : instances)
+            instance = glm::vec3{distribution(generator), distribution(generator), distribution(generator)};
+        CpuCulling culling{instances, glm::vec4{0.0f, 0.0f, 0.0f, 1.0f}};
+        std::vector<glm::vec3> visible(instanceCount);
+        size_t expected{culling.cull(planes, visible.data(), Path::Scalar)};
+
+        for (auto path : paths) {
+            // best of several runs so a context switch doesn't decide the result
+            double bestMilliseconds{std::numeric_limits<double>::max()};
+            size_t visibleCount{};
+            for (int run{}; run < 20; run++) {
+                auto start = std::chrono::high_resolution_clock::now();
+                visibleCount = culling.cull(planes, visible.data(), path);
+                auto end = std::chrono::high_resolution_clock::now();
+                bestMilliseconds = std::min(bestMilliseconds, std::chrono::duration<double, std::milli>(end - start).count());
+            }
+            std::cout << "cull " << instanceCount << " instances " << getPathName(path) << ": "
+                      << static_cast<uint64_t>(instanceCount / std::max(bestMilliseconds, 1e-6)) << " per ms, "
+                      << visibleCount << " visible" << (visibleCount == expected ? "" : " MISMATCH") << "\n";
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "commonIncludes.h"
+#include <array>
+
+// frustum culling on the cpu for when the compute path is not used, the
+// bounding spheres are kept as structure of arrays so four or eight of them
+// are tested against a plane at once, the fastest path the cpu supports is
+// picked at runtime and the scalar one is the reference the others match
+class CpuCulling {
+  public:
+    enum class Path {
+        Scalar,
+        SSE,
+        AVX2
+    };
+
+    // every instance is bounded by the mesh's sphere moved by its offset
+    CpuCulling(const std::vector<glm::vec3>& instances, const glm::vec4& boundingSphere);
+
+    // writes the offsets of the visible instances to visible in their original
+    // order and returns how many there are, visible needs room for all of them
+    size_t cull(const std::array<glm::vec4, 6>& planes, glm::vec3* visible) const;
+    size_t cull(const std::array<glm::vec4, 6>& planes, glm::vec3* visible, Path path) const;
+    size_t getInstanceCount() const;
+    Path getPath() const;
+
+    static Path getBestPath();
+    static const char* getPathName(Path path);
+    // planes of clip's frustum in the space clip transforms from, normalized
+    // so plane distances are in that space's units
+    static std::array<glm::vec4, 6> getFrustumPlanes(const glm::mat4& clip);
+    // prints instances culled per millisecond of every supported path for a
+    // few instance counts, the results are checked against the scalar path
+    static void runBenchmark();
+
+  private:
+    // padded to a multiple of eight with spheres that are always culled
+    static constexpr size_t laneCount{8};
+    std::vector<float> centerX{};
+    std::vector<float> centerY{};
+    std::vector<float> centerZ{};
+    std::vector<float> radius{};
+    std::vector<glm::vec3> offsets{};
+    Path path{Path::Scalar};
+
+    size_t cullScalar(const std::array<glm::vec4, 6>& planes, glm::vec3* visible) const;
+    size_t cullSSE(const std::array<glm::vec4, 6>& planes, glm::vec3* visible) const;
+    size_t cullAVX2(const std::array<glm::vec4, 6>& planes, glm::vec3* visible) const;
+};
@@ -0,0 +1,89 @@
+#include "CpuProfiler.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+CpuProfiler::Zone::Zone(const char* name) {
+    if (!CpuProfiler::get().isRecording())
+        return;
+    this->name = name;
+    start = now();
+}
+
+CpuProfiler::Zone::~Zone() {
+    // a zone that began before recording started is dropped
+    if (name)
+        CpuProfiler::get().record(name, start, now());
+}
+
+CpuProfiler::CpuProfiler()
+    : epoch{now()} {
+}
+
+CpuProfiler& CpuProfiler::get() {
+    static CpuProfiler profiler{};
+    return profiler;
+}
+
+int64_t CpuProfiler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CpuProfiler::start() {
+    recording.store(true, std::memory_order_relaxed);
+}
+
+void CpuProfiler::stop() {
+    recording.store(false, std::memory_order_relaxed);
+}
+
+bool CpuProfiler::isRecording() const {
+    return recording.load(std::memory_order_relaxed);
+}
+
+CpuProfiler::ThreadBuffer& CpuProfiler::getThreadBuffer() {
+    // the lock is only taken the first time a thread records a zone
+    thread_local ThreadBuffer* buffer{nullptr};
+    if (!buffer) {
+        std::lock_guard lock{buffersMutex};
+        buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = buffers.back().get();
+        buffer->threadId = static_cast<uint32_t>(buffers.size());
+    }
+    return *buffer;
+}
+
+void CpuProfiler::record(const char* name, int64_t start, int64_t end) {
+    auto& buffer = getThreadBuffer();
+    uint64_t index{buffer.writeIndex.load(std::memory_order_relaxed)};
+    buffer.events[index & (ringSize - 1)] = Event{name, start, end};
+    // publishes the event to a reader that acquires the index
+    buffer.writeIndex.store(index + 1, std::memory_order_release);
+}
+
+bool CpuProfiler::writeChromeTrace(const std::string& path) const {
+    std::ofstream file{path, std::ios::trunc};
+    if (!file.is_open()) {
+        std::cout << "failed to open cpu trace " << path << "\n";
+        return false;
+    }
+
+    // fixed notation, a long run would otherwise print the timestamps in exponent form
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    bool first{true};
+    std::lock_guard lock{buffersMutex};
+    for (const auto& buffer : buffers) {
+        uint64_t end{buffer->writeIndex.load(std::memory_order_acquire)};
+        uint64_t begin{end > ringSize ? end - ringSize : 0};
+        for (uint64_t index{begin}; index < end; index++) {
+            const auto& event = buffer->events[index & (ringSize - 1)];
+            // chrome wants microseconds, the fraction keeps the nanoseconds
+            file << (first ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                 << ",\"ts\":" << (event.start - epoch) / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+            first = false;
+        }
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    std::cout << "cpu trace written to " << path << "\n";
+    return true;
+}
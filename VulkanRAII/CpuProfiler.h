@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// scoped cpu zones written into per-thread ring buffers, a thread only ever
+// touches its own buffer so recording a zone takes no lock. the zones compile
+// away entirely unless CPU_PROFILER is defined, and while it is defined but
+// nothing is recording a zone costs a relaxed atomic load
+class CpuProfiler {
+  public:
+    class Zone {
+      public:
+        // the name has to outlive the profiler, string literals are the intended use
+        explicit Zone(const char* name);
+        ~Zone();
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+
+      private:
+        const char* name{nullptr};
+        int64_t start{};
+    };
+
+    static CpuProfiler& get();
+    void start();
+    void stop();
+    bool isRecording() const;
+    // writes every zone still held in the rings as chrome trace_event json, meant
+    // to be called once recording stopped or from a quiet point on the main thread
+    bool writeChromeTrace(const std::string& path) const;
+
+  private:
+    struct Event {
+        const char* name{nullptr};
+        int64_t start{};
+        int64_t end{};
+    };
+
+    // power of two so the write index can wrap with a mask, the oldest zones
+    // are overwritten when a thread records more than this between flushes
+    static constexpr size_t ringSize{1 << 16};
+
+    struct ThreadBuffer {
+        uint32_t threadId{};
+        std::atomic<uint64_t> writeIndex{};
+        std::unique_ptr<Event[]> events{std::make_unique<Event[]>(ringSize)};
+    };
+
+    std::atomic<bool> recording{false};
+    mutable std::mutex buffersMutex{};
+    // buffers outlive their threads so zones of finished threads still end up in the trace
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers{};
+    int64_t epoch{};
+
+    CpuProfiler();
+    static int64_t now();
+    ThreadBuffer& getThreadBuffer();
+    void record(const char* name, int64_t start, int64_t end);
+};
+
+#ifdef CPU_PROFILER
+#define CPU_PROFILER_CONCAT_(a, b) a##b
+#define CPU_PROFILER_CONCAT(a, b) CPU_PROFILER_CONCAT_(a, b)
+#define PROFILE_ZONE(name) CpuProfiler::Zone CPU_PROFILER_CONCAT(profileZone, __LINE__){name}
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#endif
@@ -0,0 +1,65 @@
+#include "FrameAllocator.h"
+#include "Renderer.h"
+#include "Resources.h"
+
+FrameAllocator::FrameAllocator(Renderer& renderer, uint32_t frameCount, vk::DeviceSize capacity)
+    : m_renderer{renderer}
+    , capacity{capacity} {
+    // the same slices may be bound as uniform or storage buffers so both limits apply
+    const auto& limits = m_renderer.m_physicalDevice.getProperties().limits;
+    alignment = std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+
+    frames.resize(frameCount);
+    for (auto& frame : frames) {
+        frame.buffer = m_renderer.pResources->createBuffer(vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer, capacity, VmaAllocationCreateFlagBits::VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, 0, frame.allocation, MemoryTelemetry::Category::Uniforms);
+        frame.ptr = m_renderer.pResources->mapPersistentMemory(m_renderer.allocator, frame.allocation, capacity);
+    }
+}
+
+FrameAllocator::~FrameAllocator() {
+    for (auto& frame : frames) {
+        frame.buffer.clear();
+        vmaUnmapMemory(m_renderer.allocator, frame.allocation);
+        m_renderer.memoryTelemetry.free(frame.allocation);
+    }
+}
+
+void FrameAllocator::beginFrame(uint32_t frameIndex) {
+    currentFrame = frameIndex;
+    head = 0;
+}
+
+FrameAllocator::Allocation FrameAllocator::allocate(vk::DeviceSize size) {
+    vk::DeviceSize offset{(head + alignment - 1) / alignment * alignment};
+    if (offset + size > capacity)
+        throw std::runtime_error("frame allocator is out of memory");
+    head = offset + size;
+    peakUsed = std::max(peakUsed, head);
+
+    auto& frame = frames[currentFrame];
+    Allocation allocation{};
+    allocation.buffer = *frame.buffer;
+    allocation.offset = static_cast<uint32_t>(offset);
+    allocation.ptr = static_cast<char*>(frame.ptr) + offset;
+    return allocation;
+}
+
+void FrameAllocator::endFrame() {
+    if (head == 0)
+        return;
+    // a no-op on coherent memory, sequential write may land in memory that isn't
+    if (vmaFlushAllocation(m_renderer.allocator, frames[currentFrame].allocation, 0, head) != VK_SUCCESS)
+        throw std::runtime_error("failed to flush the frame allocator");
+}
+
+vk::Buffer FrameAllocator::getBuffer(uint32_t frameIndex) const {
+    return *frames[frameIndex].buffer;
+}
+
+vk::DeviceSize FrameAllocator::getAlignment() const {
+    return alignment;
+}
+
+vk::DeviceSize FrameAllocator::getPeakUsed() const {
+    return peakUsed;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "commonIncludes.h"
+#include "vma/vk_mem_alloc.h"
+
+class Renderer;
+// per frame linear allocator for transient uniform and storage data, every
+// frame in flight owns a persistently mapped buffer that is rewound once the
+// frame's fence has signaled, draws reach their slice through dynamic offsets
+class FrameAllocator {
+  public:
+    struct Allocation {
+        vk::Buffer buffer{};
+        uint32_t offset{};
+        void* ptr{nullptr};
+    };
+
+    FrameAllocator(Renderer& renderer, uint32_t frameCount, vk::DeviceSize capacity);
+    ~FrameAllocator();
+    FrameAllocator(const FrameAllocator&) = delete;
+    FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+    // the frame's fence has to be signaled, everything handed out before is gone
+    void beginFrame(uint32_t frameIndex);
+    Allocation allocate(vk::DeviceSize size);
+    // copies the data into the current frame and returns its dynamic offset
+    template<typename T>
+    uint32_t push(const T* data, size_t count);
+    // flushes what was written this frame, has to happen before the submit
+    void endFrame();
+    vk::Buffer getBuffer(uint32_t frameIndex) const;
+    vk::DeviceSize getAlignment() const;
+    vk::DeviceSize getPeakUsed() const;
+
+  private:
+    struct FrameBuffer {
+        vk::raii::Buffer buffer{nullptr};
+        VmaAllocation allocation{nullptr};
+        void* ptr{nullptr};
+    };
+
+    Renderer& m_renderer;
+    std::vector<FrameBuffer> frames{};
+    vk::DeviceSize capacity{};
+    vk::DeviceSize alignment{};
+    vk::DeviceSize head{};
+    vk::DeviceSize peakUsed{};
+    uint32_t currentFrame{};
+};
+
+template<typename T>
+uint32_t FrameAllocator::push(const T* data, size_t count) {
+    auto allocation = allocate(sizeof(T) * count);
+    memcpy(allocation.ptr, data, sizeof(T) * count);
+    return allocation.offset;
+}
@@ -0,0 +1,451 @@
+#include "FrameGraph.h"
+#include "Renderer.h"
+#include "Resources.h"
+#include "GpuProfiler.h"
+
+FrameGraph::Pass& FrameGraph::Pass::writeColor(ImageHandle image, std::optional<vk::ClearValue> clear) {
+    accesses.push_back({image, StateTracker::Usage::ColorAttachment, true, true, clear});
+    return *this;
+}
+
+FrameGraph::Pass& FrameGraph::Pass::writeDepth(ImageHandle image, std::optional<vk::ClearValue> clear) {
+    accesses.push_back({image, StateTracker::Usage::DepthAttachment, true, true, clear});
+    return *this;
+}
+
+FrameGraph::Pass& FrameGraph::Pass::read(ImageHandle image, StateTracker::Usage usage) {
+    accesses.push_back({image, usage, false, false, {}});
+    return *this;
+}
+
+FrameGraph::Pass& FrameGraph::Pass::write(ImageHandle image, StateTracker::Usage usage) {
+    accesses.push_back({image, usage, true, false, {}});
+    return *this;
+}
+
+FrameGraph::Pass& FrameGraph::Pass::setSideEffect() {
+    sideEffect = true;
+    return *this;
+}
+
+FrameGraph::Pass& FrameGraph::Pass::setRenderingFlags(vk::RenderingFlags flags) {
+    renderingFlags = flags;
+    return *this;
+}
+
+FrameGraph::Pass& FrameGraph::Pass::setExecute(std::function<void(vk::raii::CommandBuffer&)> execute) {
+    this->execute = std::move(execute);
+    return *this;
+}
+
+FrameGraph::FrameGraph(Renderer& renderer)
+    : m_renderer{renderer} {
+    auto memoryProperties = m_renderer.m_physicalDevice.getMemoryProperties();
+    for (uint32_t i{}; i < memoryProperties.memoryTypeCount; i++)
+        if (memoryProperties.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eLazilyAllocated)
+            lazyMemory = true;
+}
+
+FrameGraph::~FrameGraph() {
+    releaseTransients();
+}
+
+void FrameGraph::reset() {
+    images.clear();
+    passes.clear();
+    frameNumber++;
+    // a frame recorded framesInFlight frames ago has had its fence waited on
+    std::erase_if(retired, [this](Retired& entry) {
+        if (entry.frameNumber + m_renderer.framesInFlight > frameNumber)
+            return false;
+        for (auto& transient : entry.transients)
+            destroy(transient);
+        for (auto& slot : entry.slots)
+            destroy(slot);
+        return true;
+    });
+}
+
+FrameGraph::ImageHandle FrameGraph::importImage(vk::Image image, vk::ImageView imageView, vk::Extent2D extent, bool output, std::optional<StateTracker::Usage> finalUsage) {
+    Image imported{};
+    imported.image = image;
+    imported.imageView = imageView;
+    imported.extent = extent;
+    imported.output = output;
+    imported.finalUsage = finalUsage;
+    images.push_back(imported);
+    return static_cast<ImageHandle>(images.size() - 1);
+}
+
+FrameGraph::ImageHandle FrameGraph::createImage(const std::string& name, const ImageDesc& desc) {
+    auto it = std::find_if(transients.begin(), transients.end(), [&name](const Transient& transient) { return transient.name == name; });
+    if (it != transients.end() && it->desc != desc) {
+        // usually a resize, the images declared so far keep their indices so only
+        // this transient is replaced, the aliasing is planned again in execute
+        // once the whole frame is declared
+        std::vector<Transient> old(1);
+        old[0].image = std::move(it->image);
+        old[0].imageView = std::move(it->imageView);
+        old[0].allocation = it->allocation;
+        it->image = vk::raii::Image{nullptr};
+        it->imageView = vk::raii::ImageView{nullptr};
+        it->allocation = nullptr;
+        // a lazily allocated image never had a slot, the others' plan is still fine
+        planDirty = planDirty || !it->lazy;
+        it->lazy = false;
+        it->slot = -1;
+        it->desc = desc;
+        retire(std::move(old), {});
+    }
+    if (it == transients.end()) {
+        Transient transient{};
+        transient.name = name;
+        transient.desc = desc;
+        transients.push_back(std::move(transient));
+        it = transients.end() - 1;
+    }
+
+    Image image{};
+    image.extent = desc.extent;
+    image.transient = static_cast<int>(it - transients.begin());
+    images.push_back(image);
+    return static_cast<ImageHandle>(images.size() - 1);
+}
+
+FrameGraph::Pass& FrameGraph::addRenderPass(const std::string& name) {
+    auto& pass = addPass(name);
+    pass.rendering = true;
+    return pass;
+}
+
+FrameGraph::Pass& FrameGraph::addPass(const std::string& name) {
+    Pass pass{};
+    pass.name = name;
+    passes.push_back(std::move(pass));
+    return passes.back();
+}
+
+std::vector<bool> FrameGraph::cullPasses() const {
+    // walks backwards from the outputs, a pass survives if it writes something
+    // a surviving pass or the world outside the graph still needs
+    std::vector<bool> needed(images.size(), false);
+    for (size_t i{}; i < images.size(); i++)
+        needed[i] = images[i].output;
+
+    std::vector<bool> kept(passes.size(), false);
+    for (size_t p{passes.size()}; p-- > 0;) {
+        const auto& pass = passes[p];
+        bool keep{pass.sideEffect};
+        for (const auto& access : pass.accesses)
+            keep = keep || (access.write && needed[access.image]);
+        if (!keep)
+            continue;
+        kept[p] = true;
+        // a cleared attachment does not care what was in it before
+        for (const auto& access : pass.accesses)
+            if (access.clear)
+                needed[access.image] = images[access.image].output;
+        for (const auto& access : pass.accesses)
+            if (!access.write || (access.attachment && !access.clear))
+                needed[access.image] = true;
+    }
+    return kept;
+}
+
+bool FrameGraph::isAttachmentOnly(const ImageDesc& desc) const {
+    const vk::ImageUsageFlags attachments{vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eInputAttachment};
+    return !(desc.usage & ~attachments);
+}
+
+void FrameGraph::createTransient(Transient& transient, bool lazy) {
+    vk::ImageCreateInfo imageInfo{};
+    imageInfo.imageType = vk::ImageType::e2D;
+    imageInfo.extent = vk::Extent3D{transient.desc.extent.width, transient.desc.extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = transient.desc.format;
+    imageInfo.usage = transient.desc.usage;
+    imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+    imageInfo.tiling = vk::ImageTiling::eOptimal;
+    imageInfo.sharingMode = vk::SharingMode::eExclusive;
+    imageInfo.samples = vk::SampleCountFlagBits::e1;
+    transient.lazy = lazy;
+
+    if (lazy) {
+        // on tilers the attachment may never be backed by memory at all
+        imageInfo.usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+        VmaAllocationCreateInfo allocInfo{};
+        allocInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+        vk::Image image{};
+        if (vmaCreateImage(m_renderer.allocator, reinterpret_cast<VkImageCreateInfo*>(&imageInfo), &allocInfo, reinterpret_cast<VkImage*>(&image), &transient.allocation, nullptr) != VK_SUCCESS)
+            throw std::runtime_error("failed to create lazily allocated image " + transient.name);
+        m_renderer.memoryTelemetry.track(transient.allocation, MemoryTelemetry::Category::RenderTargets);
+        transient.image = vk::raii::Image{m_renderer.m_device, image};
+    } else {
+        // memory is bound once every transient has been given a slot
+        transient.image = m_renderer.m_device.createImage(imageInfo);
+    }
+}
+
+void FrameGraph::planTransients(const std::vector<bool>& kept) {
+    for (auto& transient : transients)
+        transient.used = false;
+    for (uint32_t p{}; p < passes.size(); p++) {
+        if (!kept[p])
+            continue;
+        for (const auto& access : passes[p].accesses) {
+            int index{images[access.image].transient};
+            if (index < 0)
+                continue;
+            auto& transient = transients[index];
+            if (!transient.used) {
+                transient.used = true;
+                transient.firstPass = p;
+            }
+            transient.lastPass = p;
+        }
+    }
+
+    std::vector<std::tuple<std::string, uint32_t, uint32_t>> lifetimes{};
+    for (auto& transient : transients) {
+        if (!transient.used)
+            continue;
+        if (!*transient.image && lazyMemory && isAttachmentOnly(transient.desc)) {
+            createTransient(transient, true);
+            transient.imageView = m_renderer.pResources->createImageView(*transient.image, transient.desc.format, transient.desc.aspect);
+            m_renderer.stateTracker.registerImage(*transient.image, transient.desc.aspect);
+        }
+        if (!transient.lazy)
+            lifetimes.emplace_back(transient.name, transient.firstPass, transient.lastPass);
+    }
+    if (lifetimes == plannedLifetimes && !planDirty)
+        return;
+
+    // a different set of passes needs a different aliasing plan, the old images
+    // may still be in use by the frames in flight
+    std::vector<Transient> oldTransients{};
+    for (auto& transient : transients) {
+        if (transient.lazy || !*transient.image)
+            continue;
+        Transient old{};
+        old.image = std::move(transient.image);
+        old.imageView = std::move(transient.imageView);
+        transient.image = vk::raii::Image{nullptr};
+        transient.imageView = vk::raii::ImageView{nullptr};
+        transient.slot = -1;
+        oldTransients.push_back(std::move(old));
+    }
+    retire(std::move(oldTransients), std::move(slots));
+    slots.clear();
+
+    // greedy first fit in order of first use, a slot takes a transient when none
+    // of its lifetimes overlap and they agree on a memory type
+    std::vector<Transient*> order{};
+    for (auto& transient : transients)
+        if (transient.used && !transient.lazy)
+            order.push_back(&transient);
+    std::sort(order.begin(), order.end(), [](const Transient* a, const Transient* b) { return a->firstPass < b->firstPass; });
+    for (auto* transient : order) {
+        createTransient(*transient, false);
+        auto requirements = transient->image.getMemoryRequirements();
+        for (size_t s{}; s < slots.size() && transient->slot < 0; s++) {
+            auto& slot = slots[s];
+            if (!(slot.requirements.memoryTypeBits & requirements.memoryTypeBits))
+                continue;
+            bool overlaps{false};
+            for (const auto& [first, last] : slot.lifetimes)
+                overlaps = overlaps || (transient->firstPass <= last && first <= transient->lastPass);
+            if (overlaps)
+                continue;
+            slot.requirements.size = std::max(slot.requirements.size, requirements.size);
+            slot.requirements.alignment = std::max(slot.requirements.alignment, requirements.alignment);
+            slot.requirements.memoryTypeBits &= requirements.memoryTypeBits;
+            slot.lifetimes.emplace_back(transient->firstPass, transient->lastPass);
+            slot.users++;
+            transient->slot = static_cast<int>(s);
+        }
+        if (transient->slot < 0) {
+            MemorySlot slot{};
+            slot.requirements = requirements;
+            slot.lifetimes.emplace_back(transient->firstPass, transient->lastPass);
+            slot.users = 1;
+            slots.push_back(std::move(slot));
+            transient->slot = static_cast<int>(slots.size() - 1);
+        }
+    }
+
+    for (auto& slot : slots) {
+        VmaAllocationCreateInfo allocInfo{};
+        allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        VkMemoryRequirements requirements = slot.requirements;
+        if (vmaAllocateMemory(m_renderer.allocator, &requirements, &allocInfo, &slot.allocation, nullptr) != VK_SUCCESS)
+            throw std::runtime_error("failed to allocate frame graph memory");
+        m_renderer.memoryTelemetry.track(slot.allocation, MemoryTelemetry::Category::RenderTargets);
+    }
+    for (auto* transient : order) {
+        if (vmaBindImageMemory(m_renderer.allocator, slots[transient->slot].allocation, *transient->image) != VK_SUCCESS)
+            throw std::runtime_error("failed to bind frame graph memory");
+        transient->imageView = m_renderer.pResources->createImageView(*transient->image, transient->desc.format, transient->desc.aspect);
+        m_renderer.stateTracker.registerImage(*transient->image, transient->desc.aspect);
+    }
+    plannedLifetimes = std::move(lifetimes);
+    planDirty = false;
+}
+
+void FrameGraph::execute(vk::raii::CommandBuffer& commandBuffer) {
+    auto kept = cullPasses();
+    planTransients(kept);
+    for (auto& image : images) {
+        if (image.transient < 0)
+            continue;
+        image.image = *transients[image.transient].image;
+        image.imageView = *transients[image.transient].imageView;
+    }
+
+    // the contents of an image are worth keeping when a later surviving pass
+    // looks at them or the image leaves the graph
+    std::vector<int> lastAccess(images.size(), -1);
+    for (uint32_t p{}; p < passes.size(); p++)
+        if (kept[p])
+            for (const auto& access : passes[p].accesses)
+                lastAccess[access.image] = static_cast<int>(p);
+
+    auto& states = m_renderer.stateTracker;
+    std::vector<bool> written(images.size(), false);
+    for (uint32_t p{}; p < passes.size(); p++) {
+        if (!kept[p]) {
+            culledPasses++;
+            continue;
+        }
+        auto& pass = passes[p];
+        std::vector<vk::RenderingAttachmentInfo> colorAttachments{};
+        std::optional<vk::RenderingAttachmentInfo> depthAttachment{};
+        vk::Extent2D renderExtent{};
+        for (const auto& access : pass.accesses) {
+            auto& image = images[access.image];
+            // transients start every frame empty, imported images carry their contents in
+            bool hasContents{written[access.image] || image.transient < 0};
+            bool discard{access.clear.has_value() || (access.write && !hasContents)};
+            if (image.transient >= 0 && transients[image.transient].slot >= 0) {
+                auto& slot = slots[transients[image.transient].slot];
+                if (slot.users > 1 && slot.lastUser != image.image) {
+                    // aliased memory, the previous occupant's work has to finish first
+                    if (slot.lastUser) {
+                        auto previous = states.getImageState(slot.lastUser);
+                        states.assume(image.image, {vk::ImageLayout::eUndefined, previous.stages, previous.access});
+                    }
+                    slot.lastUser = image.image;
+                    discard = true;
+                }
+            }
+            states.use(image.image, access.usage, discard);
+
+            if (!access.attachment)
+                continue;
+            vk::RenderingAttachmentInfo attachment{};
+            attachment.imageView = image.imageView;
+            attachment.imageLayout = StateTracker::getState(access.usage).layout;
+            if (access.clear) {
+                attachment.loadOp = vk::AttachmentLoadOp::eClear;
+                attachment.clearValue = *access.clear;
+            } else {
+                attachment.loadOp = hasContents ? vk::AttachmentLoadOp::eLoad : vk::AttachmentLoadOp::eDontCare;
+            }
+            bool readLater{image.output || lastAccess[access.image] > static_cast<int>(p)};
+            attachment.storeOp = readLater ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+            renderExtent = image.extent;
+            if (access.usage == StateTracker::Usage::DepthAttachment)
+                depthAttachment = attachment;
+            else
+                colorAttachments.push_back(attachment);
+        }
+        for (const auto& access : pass.accesses)
+            if (access.write)
+                written[access.image] = true;
+        states.flush(commandBuffer);
+
+        // outside the rendering so it works for passes recorded into secondaries too
+        GpuProfiler::Scope scope{m_renderer.pGpuProfiler.get(), commandBuffer, pass.name.c_str()};
+        if (pass.rendering) {
+            vk::RenderingInfo renderingInfo{};
+            renderingInfo.flags = pass.renderingFlags;
+            renderingInfo.renderArea = vk::Rect2D{{0, 0}, renderExtent};
+            renderingInfo.layerCount = 1;
+            renderingInfo.colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size());
+            renderingInfo.pColorAttachments = colorAttachments.data();
+            renderingInfo.pDepthAttachment = depthAttachment ? &*depthAttachment : nullptr;
+            commandBuffer.beginRendering(renderingInfo);
+            if (pass.execute)
+                pass.execute(commandBuffer);
+            commandBuffer.endRendering();
+        } else if (pass.execute) {
+            pass.execute(commandBuffer);
+        }
+        executedPasses++;
+    }
+
+    for (const auto& image : images)
+        if (image.finalUsage)
+            states.use(image.image, *image.finalUsage);
+    states.flush(commandBuffer);
+}
+
+vk::Image FrameGraph::getImage(ImageHandle image) const {
+    return images[image].image;
+}
+
+void FrameGraph::retire(std::vector<Transient>&& oldTransients, std::vector<MemorySlot>&& oldSlots) {
+    Retired entry{};
+    entry.frameNumber = frameNumber;
+    entry.transients = std::move(oldTransients);
+    entry.slots = std::move(oldSlots);
+    retired.push_back(std::move(entry));
+}
+
+void FrameGraph::destroy(Transient& transient) {
+    transient.imageView.clear();
+    transient.image.clear();
+    if (transient.allocation) {
+        m_renderer.memoryTelemetry.free(transient.allocation);
+        transient.allocation = nullptr;
+    }
+}
+
+void FrameGraph::destroy(MemorySlot& slot) {
+    if (slot.allocation) {
+        m_renderer.memoryTelemetry.free(slot.allocation);
+        slot.allocation = nullptr;
+    }
+}
+
+void FrameGraph::releaseTransients() {
+    // images before the memory they are bound to
+    for (auto& entry : retired)
+        for (auto& transient : entry.transients)
+            destroy(transient);
+    for (auto& transient : transients)
+        destroy(transient);
+    for (auto& entry : retired)
+        for (auto& slot : entry.slots)
+            destroy(slot);
+    for (auto& slot : slots)
+        destroy(slot);
+    retired.clear();
+    transients.clear();
+    slots.clear();
+    plannedLifetimes.clear();
+    planDirty = false;
+}
+
+void FrameGraph::printStats() const {
+    vk::DeviceSize aliasedBytes{};
+    vk::DeviceSize imageBytes{};
+    for (const auto& slot : slots)
+        aliasedBytes += slot.requirements.size;
+    for (const auto& transient : transients)
+        if (*transient.image && !transient.lazy)
+            imageBytes += transient.image.getMemoryRequirements().size;
+    std::cout << "frame graph: " << executedPasses << " passes executed, " << culledPasses << " culled, "
+              << transients.size() << " transient images in " << slots.size() << " memory slots ("
+              << aliasedBytes / 1024 << " KiB for " << imageBytes / 1024 << " KiB of images)\n";
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include "commonIncludes.h"
+#include "vma/vk_mem_alloc.h"
+#include "StateTracker.h"
+#include <deque>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+
+class Renderer;
+// the frame is described as passes that declare which images they read and
+// write, execute() drops passes nothing depends on, derives the barriers and
+// the attachment load and store ops and records the rest in order. transient
+// images belong to the graph, the ones whose lifetimes within a frame don't
+// overlap share memory and attachment only ones use lazily allocated memory
+// where the device has it
+class FrameGraph {
+  public:
+    using ImageHandle = uint32_t;
+
+    struct ImageDesc {
+        vk::Format format{};
+        vk::Extent2D extent{};
+        vk::ImageUsageFlags usage{};
+        vk::ImageAspectFlags aspect{};
+        bool operator==(const ImageDesc&) const = default;
+    };
+
+    class Pass {
+      public:
+        // a clear value makes the pass clear the attachment, otherwise it is loaded
+        // when an earlier pass wrote it
+        Pass& writeColor(ImageHandle image, std::optional<vk::ClearValue> clear = {});
+        Pass& writeDepth(ImageHandle image, std::optional<vk::ClearValue> clear = {});
+        Pass& read(ImageHandle image, StateTracker::Usage usage);
+        Pass& write(ImageHandle image, StateTracker::Usage usage);
+        // for passes whose results leave the graph some other way, they are never culled
+        Pass& setSideEffect();
+        Pass& setRenderingFlags(vk::RenderingFlags flags);
+        Pass& setExecute(std::function<void(vk::raii::CommandBuffer&)> execute);
+
+      private:
+        friend class FrameGraph;
+        struct Access {
+            ImageHandle image{};
+            StateTracker::Usage usage{};
+            bool write{false};
+            bool attachment{false};
+            std::optional<vk::ClearValue> clear{};
+        };
+        std::string name{};
+        bool rendering{false};
+        bool sideEffect{false};
+        vk::RenderingFlags renderingFlags{};
+        std::vector<Access> accesses{};
+        std::function<void(vk::raii::CommandBuffer&)> execute{};
+    };
+
+    FrameGraph(Renderer& renderer);
+    ~FrameGraph();
+    FrameGraph(const FrameGraph&) = delete;
+    FrameGraph& operator=(const FrameGraph&) = delete;
+
+    // drops last frame's passes and imports, the transient images are kept
+    void reset();
+    // output images are still needed after the graph so they are always stored and
+    // keep their writers alive, finalUsage is the state they are left in
+    ImageHandle importImage(vk::Image image, vk::ImageView imageView, vk::Extent2D extent, bool output, std::optional<StateTracker::Usage> finalUsage = {});
+    ImageHandle createImage(const std::string& name, const ImageDesc& desc);
+    Pass& addRenderPass(const std::string& name);
+    Pass& addPass(const std::string& name);
+    void execute(vk::raii::CommandBuffer& commandBuffer);
+    // only valid inside a pass' execute callback, transients get their image in execute
+    vk::Image getImage(ImageHandle image) const;
+    // the gpu has to be idle
+    void releaseTransients();
+    void printStats() const;
+
+  private:
+    struct Image {
+        vk::Image image{};
+        vk::ImageView imageView{};
+        vk::Extent2D extent{};
+        bool output{false};
+        std::optional<StateTracker::Usage> finalUsage{};
+        // index into transients, -1 for imported images
+        int transient{-1};
+    };
+
+    struct Transient {
+        std::string name{};
+        ImageDesc desc{};
+        vk::raii::Image image{nullptr};
+        vk::raii::ImageView imageView{nullptr};
+        // only set for lazily allocated images, the aliased ones live in a memory slot
+        VmaAllocation allocation{nullptr};
+        bool lazy{false};
+        int slot{-1};
+        // first and last pass of this frame that uses it, used to plan the aliasing
+        uint32_t firstPass{};
+        uint32_t lastPass{};
+        bool used{false};
+    };
+
+    struct MemorySlot {
+        VmaAllocation allocation{nullptr};
+        std::vector<std::pair<uint32_t, uint32_t>> lifetimes{};
+        vk::MemoryRequirements requirements{};
+        // the image that touched the memory last, the next one has to wait for it
+        vk::Image lastUser{};
+        uint32_t users{};
+    };
+
+    // transients and slots that were replaced, destroyed once no frame in flight can use them
+    struct Retired {
+        uint64_t frameNumber{};
+        std::vector<Transient> transients{};
+        std::vector<MemorySlot> slots{};
+    };
+
+    Renderer& m_renderer;
+    bool lazyMemory{false};
+    uint64_t frameNumber{};
+    std::vector<Image> images{};
+    // a deque so the references addPass hands out stay valid
+    std::deque<Pass> passes{};
+    std::vector<Transient> transients{};
+    std::vector<MemorySlot> slots{};
+    std::vector<Retired> retired{};
+    // the lifetimes the current slots were planned for
+    std::vector<std::tuple<std::string, uint32_t, uint32_t>> plannedLifetimes{};
+    // set when a transient was recreated with a new desc, its slot no longer fits
+    bool planDirty{false};
+    uint64_t culledPasses{};
+    uint64_t executedPasses{};
+
+    std::vector<bool> cullPasses() const;
+    void planTransients(const std::vector<bool>& kept);
+    void createTransient(Transient& transient, bool lazy);
+    void retire(std::vector<Transient>&& oldTransients, std::vector<MemorySlot>&& oldSlots);
+    void destroy(Transient& transient);
+    void destroy(MemorySlot& slot);
+    bool isAttachmentOnly(const ImageDesc& desc) const;
+};
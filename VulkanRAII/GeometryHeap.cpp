@@ -0,0 +1,136 @@
+#include "GeometryHeap.h"
+#include "Renderer.h"
+#include "Resources.h"
+
+GeometryHeap::GeometryHeap(Renderer& renderer, vk::DeviceSize vertexCapacity, vk::DeviceSize indexCapacity)
+    : m_renderer{renderer}
+    , vertexCapacity{vertexCapacity}
+    , indexCapacity{indexCapacity}
+    , vertexRanges{vertexCapacity}
+    , indexRanges{indexCapacity} {
+    vertexBuffer = m_renderer.pResources->createBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst, vertexCapacity, 0, VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexAlloc, MemoryTelemetry::Category::Geometry);
+    indexBuffer = m_renderer.pResources->createBuffer(vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst, indexCapacity, 0, VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexAlloc, MemoryTelemetry::Category::Geometry);
+}
+
+GeometryHeap::~GeometryHeap() {
+    vertexBuffer.clear();
+    indexBuffer.clear();
+    m_renderer.memoryTelemetry.free(vertexAlloc);
+    m_renderer.memoryTelemetry.free(indexAlloc);
+}
+
+GeometryHeap::Range GeometryHeap::allocateVertices(const void* src, vk::DeviceSize size, vk::DeviceSize alignment) {
+    return allocate(vertexRanges, *vertexBuffer, src, size, alignment);
+}
+
+GeometryHeap::Range GeometryHeap::allocateIndices(const void* src, vk::DeviceSize size, vk::DeviceSize alignment) {
+    return allocate(indexRanges, *indexBuffer, src, size, alignment);
+}
+
+GeometryHeap::Range GeometryHeap::allocate(FreeList& freeList, vk::Buffer buffer, const void* src, vk::DeviceSize size, vk::DeviceSize alignment) {
+    Range range{};
+    if (size == 0)
+        return range;
+    if (!freeList.allocate(size, alignment, range.offset))
+        throw std::runtime_error("geometry heap is out of space");
+    range.size = size;
+    m_renderer.pResources->getUploadBatch().copyToBuffer(src, size, buffer, range.offset);
+    return range;
+}
+
+void GeometryHeap::freeVertices(Range& range) {
+    if (range.isValid())
+        vertexRanges.free(range.offset, range.size);
+    range = {};
+}
+
+void GeometryHeap::freeIndices(Range& range) {
+    if (range.isValid())
+        indexRanges.free(range.offset, range.size);
+    range = {};
+}
+
+vk::Buffer GeometryHeap::getVertexBuffer() const {
+    return *vertexBuffer;
+}
+
+vk::Buffer GeometryHeap::getIndexBuffer() const {
+    return *indexBuffer;
+}
+
+GeometryHeap::Stats GeometryHeap::getStats() const {
+    Stats stats{};
+    stats.vertexCapacity = vertexCapacity;
+    stats.vertexUsed = vertexRanges.getUsed();
+    stats.indexCapacity = indexCapacity;
+    stats.indexUsed = indexRanges.getUsed();
+    stats.vertexFreeRanges = vertexRanges.getFreeRangeCount();
+    stats.indexFreeRanges = indexRanges.getFreeRangeCount();
+    return stats;
+}
+
+void GeometryHeap::printStats() const {
+    auto stats = getStats();
+    std::cout << "geometry heap: vertices " << stats.vertexUsed / 1024 << " / " << stats.vertexCapacity / 1024
+              << " KiB in use, " << stats.vertexFreeRanges << " free ranges, indices " << stats.indexUsed / 1024 << " / " << stats.indexCapacity / 1024
+              << " KiB in use, " << stats.indexFreeRanges << " free ranges\n";
+}
+
+GeometryHeap::FreeList::FreeList(vk::DeviceSize capacity) {
+    freeRanges.emplace(0, capacity);
+}
+
+bool GeometryHeap::FreeList::allocate(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset) {
+    // strides like 12 bytes are not powers of two so the alignment is rounded with a division
+    auto best = freeRanges.end();
+    vk::DeviceSize bestAligned{};
+    for (auto it = freeRanges.begin(); it != freeRanges.end(); it++) {
+        vk::DeviceSize aligned{(it->first + alignment - 1) / alignment * alignment};
+        vk::DeviceSize end{it->first + it->second};
+        if (aligned + size > end)
+            continue;
+        if (best == freeRanges.end() || it->second < best->second) {
+            best = it;
+            bestAligned = aligned;
+        }
+    }
+    if (best == freeRanges.end())
+        return false;
+
+    // the padding in front and whatever is left behind stay free
+    vk::DeviceSize rangeOffset{best->first};
+    vk::DeviceSize rangeEnd{best->first + best->second};
+    freeRanges.erase(best);
+    if (bestAligned > rangeOffset)
+        freeRanges.emplace(rangeOffset, bestAligned - rangeOffset);
+    if (bestAligned + size < rangeEnd)
+        freeRanges.emplace(bestAligned + size, rangeEnd - bestAligned - size);
+    offset = bestAligned;
+    used += size;
+    return true;
+}
+
+void GeometryHeap::FreeList::free(vk::DeviceSize offset, vk::DeviceSize size) {
+    used -= size;
+    auto next = freeRanges.lower_bound(offset);
+    if (next != freeRanges.end() && offset + size == next->first) {
+        size += next->second;
+        next = freeRanges.erase(next);
+    }
+    if (next != freeRanges.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return;
+        }
+    }
+    freeRanges.emplace(offset, size);
+}
+
+vk::DeviceSize GeometryHeap::FreeList::getUsed() const {
+    return used;
+}
+
+size_t GeometryHeap::FreeList::getFreeRangeCount() const {
+    return freeRanges.size();
+}
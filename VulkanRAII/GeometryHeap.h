@@ -0,0 +1,71 @@
+#pragma once
+#include "commonIncludes.h"
+#include "vma/vk_mem_alloc.h"
+#include <map>
+
+class Renderer;
+// one device local vertex buffer and one index buffer that every mesh is
+// sub-allocated from, so a frame binds them once and meshes are only
+// offsets into them
+class GeometryHeap {
+  public:
+    struct Range {
+        vk::DeviceSize offset{};
+        vk::DeviceSize size{};
+        bool isValid() const { return size != 0; }
+    };
+
+    struct Stats {
+        vk::DeviceSize vertexCapacity{};
+        vk::DeviceSize vertexUsed{};
+        vk::DeviceSize indexCapacity{};
+        vk::DeviceSize indexUsed{};
+        // free ranges in each buffer, one means there is no fragmentation
+        size_t vertexFreeRanges{};
+        size_t indexFreeRanges{};
+    };
+
+    GeometryHeap(Renderer& renderer, vk::DeviceSize vertexCapacity, vk::DeviceSize indexCapacity);
+    ~GeometryHeap();
+    GeometryHeap(const GeometryHeap&) = delete;
+    GeometryHeap& operator=(const GeometryHeap&) = delete;
+
+    // the offset is a multiple of alignment so it can be turned into a
+    // vertexOffset or firstIndex, the data goes out with the current upload batch
+    Range allocateVertices(const void* src, vk::DeviceSize size, vk::DeviceSize alignment);
+    Range allocateIndices(const void* src, vk::DeviceSize size, vk::DeviceSize alignment);
+    // the gpu has to be done with the range, same as destroying a buffer
+    void freeVertices(Range& range);
+    void freeIndices(Range& range);
+    vk::Buffer getVertexBuffer() const;
+    vk::Buffer getIndexBuffer() const;
+    Stats getStats() const;
+    void printStats() const;
+
+  private:
+    // best fit over the free ranges keyed by offset, neighbours are merged on free
+    class FreeList {
+      public:
+        explicit FreeList(vk::DeviceSize capacity);
+        bool allocate(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset);
+        void free(vk::DeviceSize offset, vk::DeviceSize size);
+        vk::DeviceSize getUsed() const;
+        size_t getFreeRangeCount() const;
+
+      private:
+        std::map<vk::DeviceSize, vk::DeviceSize> freeRanges{};
+        vk::DeviceSize used{};
+    };
+
+    Renderer& m_renderer;
+    vk::raii::Buffer vertexBuffer{nullptr};
+    VmaAllocation vertexAlloc{nullptr};
+    vk::raii::Buffer indexBuffer{nullptr};
+    VmaAllocation indexAlloc{nullptr};
+    vk::DeviceSize vertexCapacity{};
+    vk::DeviceSize indexCapacity{};
+    FreeList vertexRanges;
+    FreeList indexRanges;
+
+    Range allocate(FreeList& freeList, vk::Buffer buffer, const void* src, vk::DeviceSize size, vk::DeviceSize alignment);
+};
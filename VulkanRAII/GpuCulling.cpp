@@ -0,0 +1,136 @@
+#include "GpuCulling.h"
+#include "CpuCulling.h"
+#include "Graphics.h"
+#include "Renderer.h"
+
+GpuCulling::GpuCulling(Renderer& renderer, const std::vector<glm::vec3>& instances, const Resources::Mesh& mesh)
+    : m_renderer{renderer}
+    , mesh{mesh}
+    , instanceCount{static_cast<uint32_t>(instances.size())} {
+    auto& resources = *m_renderer.pResources;
+    // every instance is bounded by the mesh's sphere moved by its offset,
+    // the center is pushed once so the buffer only holds offset and radius
+    std::vector<glm::vec4> bounds(instances.size());
+    for (size_t index{}; index < instances.size(); index++)
+        bounds[index] = glm::vec4{instances[index], mesh.boundingSphere.w};
+    vk::DeviceSize boundsSize{sizeof(bounds[0]) * std::max<size_t>(bounds.size(), 1)};
+    boundsBuffer = resources.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, boundsSize, 0, VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, boundsAlloc, MemoryTelemetry::Category::Geometry);
+    if (!bounds.empty())
+        resources.getUploadBatch().copyToBuffer(bounds.data(), sizeof(bounds[0]) * bounds.size(), *boundsBuffer);
+
+    // written by the pass that reads them, so every frame in flight needs its own
+    vk::DeviceSize visibleSize{sizeof(glm::vec3) * std::max<size_t>(instances.size(), 1)};
+    frames.resize(m_renderer.framesInFlight);
+    for (auto& frame : frames) {
+        frame.visibleBuffer = resources.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer, visibleSize, 0, VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.visibleAlloc, MemoryTelemetry::Category::Geometry);
+        frame.drawBuffer = resources.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst, sizeof(DrawCommands), 0, VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.drawAlloc, MemoryTelemetry::Category::Geometry);
+    }
+    createDescriptorSets();
+}
+
+GpuCulling::~GpuCulling() {
+    for (auto& frame : frames) {
+        frame.descriptorSet.clear();
+        frame.visibleBuffer.clear();
+        frame.drawBuffer.clear();
+        m_renderer.memoryTelemetry.free(frame.visibleAlloc);
+        m_renderer.memoryTelemetry.free(frame.drawAlloc);
+    }
+    descriptorPool.clear();
+    boundsBuffer.clear();
+    m_renderer.memoryTelemetry.free(boundsAlloc);
+}
+
+void GpuCulling::createDescriptorSets() {
+    const uint32_t frameCount{static_cast<uint32_t>(frames.size())};
+    vk::DescriptorPoolSize poolSize{};
+    poolSize.type = vk::DescriptorType::eStorageBuffer;
+    poolSize.descriptorCount = 3 * frameCount;
+
+    vk::DescriptorPoolCreateInfo poolInfo{};
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = frameCount;
+    poolInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+    descriptorPool = m_renderer.m_device.createDescriptorPool(poolInfo);
+
+    std::vector<vk::DescriptorSetLayout> layouts(frameCount, *m_renderer.pGraphics->cullDescriptorSetLayout);
+    vk::DescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.descriptorPool = *descriptorPool;
+    allocateInfo.descriptorSetCount = frameCount;
+    allocateInfo.pSetLayouts = layouts.data();
+    auto descriptorSets = m_renderer.m_device.allocateDescriptorSets(allocateInfo);
+
+    for (uint32_t index{}; index < frameCount; index++) {
+        auto& frame = frames[index];
+        frame.descriptorSet = std::move(descriptorSets[index]);
+
+        std::array<vk::DescriptorBufferInfo, 3> bufferInfos{};
+        bufferInfos[0].buffer = *boundsBuffer;
+        bufferInfos[0].range = VK_WHOLE_SIZE;
+        bufferInfos[1].buffer = *frame.visibleBuffer;
+        bufferInfos[1].range = VK_WHOLE_SIZE;
+        bufferInfos[2].buffer = *frame.drawBuffer;
+        bufferInfos[2].range = VK_WHOLE_SIZE;
+
+        std::array<vk::WriteDescriptorSet, 3> descriptorWrite{};
+        for (uint32_t binding{}; binding < descriptorWrite.size(); binding++) {
+            descriptorWrite[binding].dstSet = *frame.descriptorSet;
+            descriptorWrite[binding].dstBinding = binding;
+            descriptorWrite[binding].dstArrayElement = 0;
+            descriptorWrite[binding].descriptorType = vk::DescriptorType::eStorageBuffer;
+            descriptorWrite[binding].descriptorCount = 1;
+            descriptorWrite[binding].pBufferInfo = &bufferInfos[binding];
+        }
+        m_renderer.m_device.updateDescriptorSets(descriptorWrite, nullptr);
+    }
+}
+
+void GpuCulling::recordCulling(vk::raii::CommandBuffer& commandBuffer, uint32_t frameIndex, const glm::mat4& clip) {
+    auto& frame = frames[frameIndex];
+    auto& graphics = *m_renderer.pGraphics;
+
+    // the compute pass only counts instances up, the rest of the command is reset here
+    DrawCommands drawCommands{};
+    drawCommands.command.indexCount = mesh.indicesCount;
+    drawCommands.command.instanceCount = 0;
+    drawCommands.command.firstIndex = mesh.firstIndex;
+    drawCommands.command.vertexOffset = mesh.vertexOffset;
+    drawCommands.command.firstInstance = 0;
+    drawCommands.drawCount = 0;
+    commandBuffer.updateBuffer<DrawCommands>(*frame.drawBuffer, 0, drawCommands);
+
+    vk::MemoryBarrier resetBarrier{};
+    resetBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    resetBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, resetBarrier, nullptr, nullptr);
+
+    PushConstants constants{};
+    constants.planes = CpuCulling::getFrustumPlanes(clip);
+    constants.sphereCenter = glm::vec4{glm::vec3{mesh.boundingSphere}, 0.0f};
+    constants.instanceCount = instanceCount;
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *graphics.cullPipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *graphics.cullPipelineLayout, 0, *frame.descriptorSet, nullptr);
+    commandBuffer.pushConstants<PushConstants>(*graphics.cullPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, constants);
+    commandBuffer.dispatch((instanceCount + workGroupSize - 1) / workGroupSize, 1, 1);
+
+    vk::MemoryBarrier cullBarrier{};
+    cullBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+    cullBarrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eVertexAttributeRead;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput, {}, cullBarrier, nullptr, nullptr);
+}
+
+void GpuCulling::recordDraw(vk::raii::CommandBuffer& commandBuffer, uint32_t frameIndex) {
+    auto& frame = frames[frameIndex];
+    commandBuffer.bindVertexBuffers(1, *frame.visibleBuffer, {0});
+    // without drawIndirectCount the draw still goes out, an empty frustum
+    // just leaves its instance count at zero
+    if (m_renderer.drawIndirectCount)
+        commandBuffer.drawIndexedIndirectCount(*frame.drawBuffer, offsetof(DrawCommands, command), *frame.drawBuffer, offsetof(DrawCommands, drawCount), 1, sizeof(DrawCommands));
+    else
+        commandBuffer.drawIndexedIndirect(*frame.drawBuffer, offsetof(DrawCommands, command), 1, sizeof(DrawCommands));
+}
+
+uint32_t GpuCulling::getInstanceCount() const {
+    return instanceCount;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "commonIncludes.h"
+#include "vma/vk_mem_alloc.h"
+#include "Resources.h"
+
+class Renderer;
+// frustum culls the instances of one mesh in a compute pass, the surviving
+// instance offsets are compacted into a per-frame vertex buffer and the draw
+// is fed from an indirect command the same pass fills in, so the cpu cost of
+// a frame does not depend on the instance count
+class GpuCulling {
+  public:
+    // matches VkDrawIndexedIndirectCommand followed by the draw count
+    struct DrawCommands {
+        vk::DrawIndexedIndirectCommand command{};
+        uint32_t drawCount{};
+    };
+
+    // laid out like the push constant block of cull.comp
+    struct PushConstants {
+        std::array<glm::vec4, 6> planes{};
+        glm::vec4 sphereCenter{};
+        uint32_t instanceCount{};
+    };
+
+    GpuCulling(Renderer& renderer, const std::vector<glm::vec3>& instances, const Resources::Mesh& mesh);
+    ~GpuCulling();
+    GpuCulling(const GpuCulling&) = delete;
+    GpuCulling& operator=(const GpuCulling&) = delete;
+
+    // has to be recorded outside of rendering, clip is the matrix the vertex
+    // shader transforms the mesh with so the planes end up in model space
+    void recordCulling(vk::raii::CommandBuffer& commandBuffer, uint32_t frameIndex, const glm::mat4& clip);
+    // draws the visible instances, the instance offsets go to vertex binding 1
+    void recordDraw(vk::raii::CommandBuffer& commandBuffer, uint32_t frameIndex);
+    uint32_t getInstanceCount() const;
+
+  private:
+    struct FrameBuffers {
+        vk::raii::Buffer visibleBuffer{nullptr};
+        VmaAllocation visibleAlloc{nullptr};
+        vk::raii::Buffer drawBuffer{nullptr};
+        VmaAllocation drawAlloc{nullptr};
+        vk::raii::DescriptorSet descriptorSet{nullptr};
+    };
+
+    static constexpr uint32_t workGroupSize{64};
+
+    Renderer& m_renderer;
+    const Resources::Mesh& mesh;
+    uint32_t instanceCount{};
+    vk::raii::Buffer boundsBuffer{nullptr};
+    VmaAllocation boundsAlloc{nullptr};
+    vk::raii::DescriptorPool descriptorPool{nullptr};
+    std::vector<FrameBuffers> frames{};
+
+    void createDescriptorSets();
+};
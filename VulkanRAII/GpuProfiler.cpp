@@ -0,0 +1,173 @@
+#include "GpuProfiler.h"
+#include "Renderer.h"
+#include <fstream>
+
+GpuProfiler::Scope::Scope(GpuProfiler* profiler, const vk::raii::CommandBuffer& commandBuffer, const char* name)
+    : profiler{profiler}
+    , commandBuffer{commandBuffer} {
+    if (profiler)
+        query = profiler->beginScope(commandBuffer, name);
+}
+
+GpuProfiler::Scope::~Scope() {
+    if (profiler)
+        profiler->endScope(commandBuffer, query);
+}
+
+GpuProfiler::GpuProfiler(Renderer& renderer, uint32_t frameCount, const std::string& dumpPath, uint32_t maxScopes)
+    : m_renderer{renderer}
+    , maxScopes{maxScopes}
+    , dumpPath{dumpPath} {
+    timestampPeriod = m_renderer.m_physicalDevice.getProperties().limits.timestampPeriod;
+    auto queueFamilies = m_renderer.m_physicalDevice.getQueueFamilyProperties();
+    uint32_t validBits{queueFamilies[m_renderer.getQueueFamilyIndex()].timestampValidBits};
+    if (validBits == 0) {
+        std::cout << "the graphics queue does not support timestamps, gpu profiling is disabled\n";
+        return;
+    }
+    timestampMask = validBits >= 64 ? ~uint64_t{} : (uint64_t{1} << validBits) - 1;
+
+    vk::QueryPoolCreateInfo poolInfo{};
+    poolInfo.queryType = vk::QueryType::eTimestamp;
+    poolInfo.queryCount = maxScopes * 2;
+    frames.resize(frameCount);
+    for (auto& frame : frames)
+        frame.pool = m_renderer.m_device.createQueryPool(poolInfo);
+}
+
+bool GpuProfiler::isSupported() const {
+    return !frames.empty();
+}
+
+void GpuProfiler::beginFrame(const vk::raii::CommandBuffer& commandBuffer, uint32_t frameIndex) {
+    if (!isSupported())
+        return;
+    currentFrame = frameIndex;
+    auto& frame = frames[frameIndex];
+    if (frame.recorded)
+        collect(frame);
+    frame.names.clear();
+    frame.recorded = true;
+    commandBuffer.resetQueryPool(*frame.pool, 0, maxScopes * 2);
+    beginScope(commandBuffer, "frame");
+
+    frameCounter++;
+    if (!dumpPath.empty() && frameCounter % dumpInterval == 0)
+        dump();
+}
+
+void GpuProfiler::endFrame(const vk::raii::CommandBuffer& commandBuffer) {
+    if (isSupported())
+        endScope(commandBuffer, 0);
+}
+
+uint32_t GpuProfiler::beginScope(const vk::raii::CommandBuffer& commandBuffer, const char* name) {
+    if (!isSupported())
+        return 0;
+    auto& frame = frames[currentFrame];
+    uint32_t scope{};
+    {
+        std::lock_guard lock{mutex};
+        if (frame.names.size() >= maxScopes)
+            return ~0u;
+        scope = static_cast<uint32_t>(frame.names.size());
+        frame.names.push_back(name);
+    }
+    commandBuffer.writeTimestamp2(vk::PipelineStageFlagBits2::eTopOfPipe, *frame.pool, scope * 2);
+    return scope;
+}
+
+void GpuProfiler::endScope(const vk::raii::CommandBuffer& commandBuffer, uint32_t scope) {
+    // scopes past maxScopes were dropped when they began
+    if (!isSupported() || scope == ~0u)
+        return;
+    commandBuffer.writeTimestamp2(vk::PipelineStageFlagBits2::eBottomOfPipe, *frames[currentFrame].pool, scope * 2 + 1);
+}
+
+void GpuProfiler::collect(FrameQueries& frame) {
+    if (frame.names.empty())
+        return;
+    const auto queryCount = static_cast<uint32_t>(frame.names.size() * 2);
+    // the fence was waited on so this never blocks, a frame that was never
+    // submitted just reports not ready and is skipped
+    auto [result, timestamps] = frame.pool.getResults<uint64_t>(0, queryCount, sizeof(uint64_t) * queryCount, sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    if (result != vk::Result::eSuccess)
+        return;
+
+    std::lock_guard lock{mutex};
+    for (size_t scope{}; scope < frame.names.size(); scope++) {
+        uint64_t ticks{(timestamps[scope * 2 + 1] - timestamps[scope * 2]) & timestampMask};
+        auto& window = samples[frame.names[scope]];
+        window.push_back(static_cast<double>(ticks) * timestampPeriod / 1e6);
+        if (window.size() > windowSize)
+            window.pop_front();
+    }
+    resolvedFrames++;
+}
+
+std::vector<GpuProfiler::ScopeStats> GpuProfiler::getStats() const {
+    std::lock_guard lock{mutex};
+    std::vector<ScopeStats> stats{};
+    for (const auto& [name, window] : samples) {
+        if (window.empty())
+            continue;
+        std::vector<double> sorted{window.begin(), window.end()};
+        std::sort(sorted.begin(), sorted.end());
+        ScopeStats scope{};
+        scope.name = name;
+        scope.minMs = sorted.front();
+        double sum{};
+        for (double ms : sorted)
+            sum += ms;
+        scope.avgMs = sum / sorted.size();
+        scope.p99Ms = sorted[std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * 0.99))];
+        scope.lastMs = window.back();
+        scope.samples = sorted.size();
+        stats.push_back(scope);
+    }
+    return stats;
+}
+
+double GpuProfiler::getLastFrameMs() const {
+    std::lock_guard lock{mutex};
+    auto it = samples.find("frame");
+    return it == samples.end() || it->second.empty() ? -1.0 : it->second.back();
+}
+
+uint64_t GpuProfiler::getResolvedFrames() const {
+    std::lock_guard lock{mutex};
+    return resolvedFrames;
+}
+
+void GpuProfiler::writeJson(const std::string& path) const {
+    std::ofstream file{path, std::ios::trunc};
+    file << "{\n  \"frames\": " << frameCounter << ",\n  \"scopes\": [";
+    auto stats = getStats();
+    for (size_t i{}; i < stats.size(); i++) {
+        const auto& scope = stats[i];
+        file << (i ? "," : "") << "\n    {\"name\": \"" << scope.name << "\", \"min_ms\": " << scope.minMs
+             << ", \"avg_ms\": " << scope.avgMs << ", \"p99_ms\": " << scope.p99Ms
+             << ", \"last_ms\": " << scope.lastMs << ", \"samples\": " << scope.samples << "}";
+    }
+    file << "\n  ]\n}\n";
+}
+
+void GpuProfiler::writeCsv(const std::string& path) const {
+    std::ofstream file{path, std::ios::trunc};
+    file << "name,min_ms,avg_ms,p99_ms,last_ms,samples\n";
+    for (const auto& scope : getStats())
+        file << scope.name << ',' << scope.minMs << ',' << scope.avgMs << ',' << scope.p99Ms << ',' << scope.lastMs << ',' << scope.samples << '\n';
+}
+
+void GpuProfiler::dump() const {
+    if (dumpPath.ends_with(".csv"))
+        writeCsv(dumpPath);
+    else
+        writeJson(dumpPath);
+}
+
+void GpuProfiler::printStats() const {
+    for (const auto& scope : getStats())
+        std::cout << "gpu " << scope.name << ": min " << scope.minMs << " ms, avg " << scope.avgMs
+                  << " ms, p99 " << scope.p99Ms << " ms over " << scope.samples << " frames\n";
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "commonIncludes.h"
+#include <deque>
+#include <map>
+#include <mutex>
+
+class Renderer;
+// timestamps around named regions of the frame's command buffers, every frame
+// in flight has its own query pool which is read back when the frame comes
+// around again so the cpu never waits on the results
+class GpuProfiler {
+  public:
+    struct ScopeStats {
+        std::string name{};
+        double minMs{};
+        double avgMs{};
+        double p99Ms{};
+        double lastMs{};
+        size_t samples{};
+    };
+
+    // writes the begin timestamp on construction and the end one on destruction
+    class Scope {
+      public:
+        Scope(GpuProfiler* profiler, const vk::raii::CommandBuffer& commandBuffer, const char* name);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        GpuProfiler* profiler{nullptr};
+        const vk::raii::CommandBuffer& commandBuffer;
+        uint32_t query{};
+    };
+
+    GpuProfiler(Renderer& renderer, uint32_t frameCount, const std::string& dumpPath = {}, uint32_t maxScopes = 64);
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    bool isSupported() const;
+    // the frame's fence has to be signaled, collects its previous results and
+    // resets the pool, has to be recorded before any scope of the frame
+    void beginFrame(const vk::raii::CommandBuffer& commandBuffer, uint32_t frameIndex);
+    void endFrame(const vk::raii::CommandBuffer& commandBuffer);
+    // safe to call from the threads recording secondary command buffers
+    uint32_t beginScope(const vk::raii::CommandBuffer& commandBuffer, const char* name);
+    void endScope(const vk::raii::CommandBuffer& commandBuffer, uint32_t query);
+    std::vector<ScopeStats> getStats() const;
+    // the whole frame's gpu time, -1 before the first frame came back
+    double getLastFrameMs() const;
+    // counts the frames whose results came back, getLastFrameMs only changed
+    // when this did
+    uint64_t getResolvedFrames() const;
+    void writeJson(const std::string& path) const;
+    void writeCsv(const std::string& path) const;
+    void dump() const;
+    void printStats() const;
+
+  private:
+    struct FrameQueries {
+        vk::raii::QueryPool pool{nullptr};
+        // one name per begin/end pair, the frame scope is always the first, they are
+        // copied since the results only come back frames later
+        std::vector<std::string> names{};
+        bool recorded{false};
+    };
+
+    static constexpr size_t windowSize{256};
+    static constexpr uint64_t dumpInterval{300};
+
+    Renderer& m_renderer;
+    std::vector<FrameQueries> frames{};
+    uint32_t currentFrame{};
+    uint32_t maxScopes{};
+    double timestampPeriod{};
+    uint64_t timestampMask{};
+    uint64_t frameCounter{};
+    uint64_t resolvedFrames{};
+    std::string dumpPath{};
+    mutable std::mutex mutex{};
+    // rolling window of milliseconds per scope name
+    std::map<std::string, std::deque<double>> samples{};
+
+    void collect(FrameQueries& frame);
+};
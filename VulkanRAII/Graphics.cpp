@@ -1,28 +1,55 @@
 #include "Graphics.h"
+#include "GpuCulling.h"
+#include "PipelineCache.h"
 #include "PresentationEngine.h"
 #include "Renderer.h"
+#include "Resources.h"
 
 Graphics::Graphics(Renderer& renderer)
     : m_renderer{renderer} {
 }
 
+Graphics::~Graphics() {
+    // tasks still running after a failed startup would write into destroyed members
+    for (auto& task : pipelineTasks) {
+        if (task.valid())
+            task.wait();
+    }
+}
+
+void Graphics::startPipelineCompilation() {
+    // every pipeline reads its own shaders and only writes its own layout and
+    // pipeline members, the driver and the shared pipeline cache are thread safe
+    auto& threadPool = m_renderer.threadPool;
+    pipelineTasks.push_back(threadPool.submit([this] { createGraphicsPipeline(); }));
+    pipelineTasks.push_back(threadPool.submit([this] { createSkyBoxPipeline(); }));
+    if (m_renderer.gpuCulling)
+        pipelineTasks.push_back(threadPool.submit([this] { createCullPipeline(); }));
+}
+
+void Graphics::waitForPipelines() {
+    PROFILE_ZONE("waitForPipelines");
+    // wait for all of them before get() can throw so none is left running
+    for (auto& task : pipelineTasks)
+        task.wait();
+    auto tasks = std::move(pipelineTasks);
+    pipelineTasks.clear();
+    for (auto& task : tasks)
+        task.get();
+}
+
 void Graphics::createDescriptorLayout() {
-    std::array<vk::DescriptorSetLayoutBinding, 2> bindings{};
+    // the sampled textures come from the texture table in set 1
+    std::array<vk::DescriptorSetLayoutBinding, 1> bindings{};
     vk::DescriptorSetLayoutCreateInfo createInfo{};
 
 
     bindings[0].binding = 0;
     bindings[0].descriptorCount = 1;
-    bindings[0].descriptorType = vk::DescriptorType::eUniformBuffer;
+    bindings[0].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
     bindings[0].stageFlags = vk::ShaderStageFlagBits::eVertex;
     bindings[0].pImmutableSamplers = nullptr;
 
-    bindings[1].binding = 1;
-    bindings[1].descriptorCount = 3;
-    bindings[1].descriptorType = vk::DescriptorType::eCombinedImageSampler;
-    bindings[1].stageFlags = vk::ShaderStageFlagBits::eFragment;
-    bindings[1].pImmutableSamplers = nullptr;
-
     createInfo.bindingCount = bindings.size();
     createInfo.pBindings = bindings.data();
 
@@ -34,10 +61,12 @@ void Graphics::createDescriptorLayout() {
 }
 
 void Graphics::createGraphicsPipeline() {
+    PROFILE_ZONE("createGraphicsPipeline");
     using Vert = Renderer::Vertex;
     
     Vert vertex{};
-    auto vertShaderModule{createShaderModules("vertex.spv")};
+    const bool compact{m_renderer.compactVertices};
+    auto vertShaderModule{createShaderModules(compact ? "vertexCompact.spv" : "vertex.spv")};
     auto fragShaderModule{createShaderModules("fragment.spv")};
  
     vk::PipelineShaderStageCreateInfo vertShaderStageInfo{};
@@ -55,7 +84,7 @@ void Graphics::createGraphicsPipeline() {
 
     vk::VertexInputBindingDescription bindingDescription{};
     bindingDescription.binding = 0;
-    bindingDescription.stride = sizeof(Renderer::Vertex);
+    bindingDescription.stride = compact ? sizeof(Resources::CompactVertex) : sizeof(Renderer::Vertex);
     bindingDescription.inputRate = vk::VertexInputRate::eVertex;
 
      vk::VertexInputBindingDescription instanceBindingDescription{};
@@ -87,11 +116,29 @@ void Graphics::createGraphicsPipeline() {
     attributeDescriptions[3].format = vk::Format::eR32G32B32Sfloat;
     attributeDescriptions[3].offset = 0;
 
+    std::array<vk::VertexInputAttributeDescription, 3> compactAttributeDescriptions{};
+    compactAttributeDescriptions[0].binding = 0;
+    compactAttributeDescriptions[0].location = 0;
+    compactAttributeDescriptions[0].format = vk::Format::eR16G16B16A16Snorm;
+    compactAttributeDescriptions[0].offset = offsetof(Resources::CompactVertex, pos);
+
+    compactAttributeDescriptions[1].binding = 0;
+    compactAttributeDescriptions[1].location = 2;
+    compactAttributeDescriptions[1].format = vk::Format::eR16G16Sfloat;
+    compactAttributeDescriptions[1].offset = offsetof(Resources::CompactVertex, texCoord);
+
+    compactAttributeDescriptions[2] = attributeDescriptions[3];
+
     vk::PipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.vertexBindingDescriptionCount = bindings.size();
     vertexInputInfo.pVertexBindingDescriptions = bindings.data();
-    vertexInputInfo.vertexAttributeDescriptionCount = attributeDescriptions.size();
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    if (compact) {
+        vertexInputInfo.vertexAttributeDescriptionCount = compactAttributeDescriptions.size();
+        vertexInputInfo.pVertexAttributeDescriptions = compactAttributeDescriptions.data();
+    } else {
+        vertexInputInfo.vertexAttributeDescriptionCount = attributeDescriptions.size();
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    }
 
     vk::PipelineInputAssemblyStateCreateInfo inputAssembly{};
     inputAssembly.topology = vk::PrimitiveTopology::eTriangleList;
@@ -147,13 +194,15 @@ void Graphics::createGraphicsPipeline() {
     pushConstant[0].size = sizeof(int);
     pushConstant[0].stageFlags = vk::ShaderStageFlagBits::eFragment;
 
+    // the vertex range also holds the two vec4 that dequantize compact positions
     pushConstant[1].offset = sizeof(int);
-    pushConstant[1].size = sizeof(int);
+    pushConstant[1].size = sizeof(int) * 3 + sizeof(glm::vec4) * 2;
     pushConstant[1].stageFlags = vk::ShaderStageFlagBits::eVertex;
-    
+
+    std::array<vk::DescriptorSetLayout, 2> setLayouts{*descriptorSetLayout, *m_renderer.pResources->textureTable->getLayout()};
     vk::PipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &(*descriptorSetLayout);
+    pipelineLayoutInfo.setLayoutCount = setLayouts.size();
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
     //pipelineLayoutInfo.pushConstantRangeCount = 0;
     //pipelineLayoutInfo.pPushConstantRanges = nullptr;
     pipelineLayoutInfo.pushConstantRangeCount = pushConstant.size();
@@ -198,10 +247,11 @@ void Graphics::createGraphicsPipeline() {
     pipelineRenderingCreateInfo.depthAttachmentFormat = vk::Format::eD32Sfloat;
     // Chain into the pipeline create info
     pipelineInfo.pNext = &pipelineRenderingCreateInfo;
-    graphicsPipeline = m_renderer.m_device.createGraphicsPipeline(nullptr, pipelineInfo);
+    graphicsPipeline = m_renderer.pPipelineCache->createGraphicsPipeline(pipelineInfo);
 }
 
 void Graphics::createSkyBoxPipeline() {
+    PROFILE_ZONE("createSkyBoxPipeline");
     auto vertShaderModule{createShaderModules("skyVert.spv")};
     auto fragShaderModule{createShaderModules("skyFrag.spv")};
 
@@ -333,7 +383,7 @@ void Graphics::createSkyBoxPipeline() {
     pipelineRenderingCreateInfo.depthAttachmentFormat = vk::Format::eD32Sfloat;
     // Chain into the pipeline create info
     pipelineInfo.pNext = &pipelineRenderingCreateInfo;
-    skyGraphicsPipeline = m_renderer.m_device.createGraphicsPipeline(nullptr, pipelineInfo);
+    skyGraphicsPipeline = m_renderer.pPipelineCache->createGraphicsPipeline(pipelineInfo);
 }
 
 void Graphics::createSkyBoxDescriptorLayout() {
@@ -342,7 +392,7 @@ void Graphics::createSkyBoxDescriptorLayout() {
 
     bindings[0].binding = 0;
     bindings[0].descriptorCount = 1;
-    bindings[0].descriptorType = vk::DescriptorType::eUniformBuffer;
+    bindings[0].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
     bindings[0].stageFlags = vk::ShaderStageFlagBits::eVertex;
     bindings[0].pImmutableSamplers = nullptr;
 
@@ -408,7 +458,57 @@ void Graphics::createComputePipeline() {
     pipelineInfo.stage = computeShaderStageInfo;
     pipelineInfo.layout = *computePipelineLayout;
 
-    computePipeline = m_renderer.m_device.createComputePipeline(nullptr, pipelineInfo);
+    computePipeline = m_renderer.pPipelineCache->createComputePipeline(pipelineInfo);
+}
+
+void Graphics::createCullDescriptorLayout() {
+    // instance bounds in, compacted instance offsets and the indirect draw out
+    std::array<vk::DescriptorSetLayoutBinding, 3> bindings{};
+    vk::DescriptorSetLayoutCreateInfo createInfo{};
+
+    for (uint32_t binding{}; binding < bindings.size(); binding++) {
+        bindings[binding].binding = binding;
+        bindings[binding].descriptorCount = 1;
+        bindings[binding].descriptorType = vk::DescriptorType::eStorageBuffer;
+        bindings[binding].stageFlags = vk::ShaderStageFlagBits::eCompute;
+        bindings[binding].pImmutableSamplers = nullptr;
+    }
+    createInfo.bindingCount = bindings.size();
+    createInfo.pBindings = bindings.data();
+
+    try {
+        cullDescriptorSetLayout = m_renderer.m_device.createDescriptorSetLayout(createInfo);
+    } catch (vk::Error& err) {
+        std::cout << err.what();
+    }
+}
+
+void Graphics::createCullPipeline() {
+    PROFILE_ZONE("createCullPipeline");
+    auto cullShaderModule{createShaderModules("cull.spv")};
+
+    vk::PipelineShaderStageCreateInfo cullShaderStageInfo{};
+    cullShaderStageInfo.stage = vk::ShaderStageFlagBits::eCompute;
+    cullShaderStageInfo.module = *cullShaderModule;
+    cullShaderStageInfo.pName = "main";
+
+    vk::PushConstantRange range{};
+    range.offset = 0;
+    range.size = sizeof(GpuCulling::PushConstants);
+    range.stageFlags = vk::ShaderStageFlagBits::eCompute;
+    vk::PipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &(*cullDescriptorSetLayout);
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &range;
+
+    cullPipelineLayout = m_renderer.m_device.createPipelineLayout(pipelineLayoutInfo);
+
+    vk::ComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.stage = cullShaderStageInfo;
+    pipelineInfo.layout = *cullPipelineLayout;
+
+    cullPipeline = m_renderer.pPipelineCache->createComputePipeline(pipelineInfo);
 }
 
 vk::raii::ShaderModule Graphics::createShaderModules(const std::string& fileName) {
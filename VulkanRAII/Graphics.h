@@ -1,12 +1,14 @@
 #pragma once
 #include "commonIncludes.h"
 #include <fstream>
+#include <future>
 
 class Renderer;
 class Graphics {
   private:
     Renderer& m_renderer;
     vk::raii::ShaderModule createShaderModules(const std::string& fileName);
+    std::vector<std::future<void>> pipelineTasks{};
 
   public:
     vk::raii::RenderPass renderPass{nullptr};
@@ -19,13 +21,24 @@ class Graphics {
     vk::raii::Pipeline computePipeline{nullptr};
     vk::raii::DescriptorSetLayout computeDescriptorSetLayout{nullptr};
     vk::raii::PipelineLayout computePipelineLayout{nullptr};
+    vk::raii::DescriptorSetLayout cullDescriptorSetLayout{nullptr};
+    vk::raii::PipelineLayout cullPipelineLayout{nullptr};
+    vk::raii::Pipeline cullPipeline{nullptr};
 
     Graphics(Renderer& renderer);
+    ~Graphics();
+    // queues every pipeline on the renderer's thread pool, the descriptor set
+    // layouts have to exist already and nothing may use a pipeline before
+    // waitForPipelines has returned
+    void startPipelineCompilation();
+    void waitForPipelines();
     void createDescriptorLayout();
     void createGraphicsPipeline();
     void createSkyBoxPipeline();
     void createSkyBoxDescriptorLayout();
     void createComputeDescriptorLayout();
     void createComputePipeline();
+    void createCullDescriptorLayout();
+    void createCullPipeline();
     void createRenderPass();
 };
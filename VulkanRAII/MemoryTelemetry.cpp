@@ -0,0 +1,167 @@
+#include "MemoryTelemetry.h"
+#include <fstream>
+
+void MemoryTelemetry::init(VmaAllocator allocator, bool budgetExtension, const std::string& dumpPath) {
+    this->allocator = allocator;
+    this->budgetExtension = budgetExtension;
+    this->dumpPath = dumpPath;
+    if (!budgetExtension)
+        std::cout << "VK_EXT_memory_budget is not supported, the heap budgets are estimates\n";
+}
+
+void MemoryTelemetry::track(VmaAllocation allocation, Category category) {
+    if (!allocation)
+        return;
+    VmaAllocationInfo info{};
+    vmaGetAllocationInfo(allocator, allocation, &info);
+    // shows up as the name of the allocation in the detailed stats string
+    vmaSetAllocationName(allocator, allocation, getCategoryName(category));
+
+    std::lock_guard lock{mutex};
+    allocations[allocation] = {category, info.size};
+    auto& stats = categories[static_cast<size_t>(category)];
+    stats.bytes += info.size;
+    stats.peakBytes = std::max(stats.peakBytes, stats.bytes);
+    stats.count++;
+}
+
+void MemoryTelemetry::free(VmaAllocation allocation) {
+    if (!allocation)
+        return;
+    {
+        std::lock_guard lock{mutex};
+        auto it = allocations.find(allocation);
+        if (it != allocations.end()) {
+            auto& stats = categories[static_cast<size_t>(it->second.first)];
+            stats.bytes -= it->second.second;
+            stats.count--;
+            allocations.erase(it);
+        }
+    }
+    vmaFreeMemory(allocator, allocation);
+}
+
+void MemoryTelemetry::nextFrame() {
+    vmaSetCurrentFrameIndex(allocator, ++frameCounter);
+    checkBudget();
+    if (!dumpPath.empty() && frameCounter % dumpInterval == 0)
+        dump();
+}
+
+void MemoryTelemetry::checkBudget() {
+    const VkPhysicalDeviceMemoryProperties* properties{nullptr};
+    vmaGetMemoryProperties(allocator, &properties);
+    std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+    vmaGetHeapBudgets(allocator, budgets.data());
+    for (uint32_t heap{}; heap < properties->memoryHeapCount; heap++) {
+        uint32_t bit{1u << heap};
+        bool over{budgets[heap].budget > 0 && budgets[heap].usage >= budgetWarning * budgets[heap].budget};
+        // only warn again once the heap went back under the threshold
+        if (over && !(warnedHeaps & bit))
+            std::cout << "memory heap " << heap << " uses " << budgets[heap].usage / (1024 * 1024) << " of its "
+                      << budgets[heap].budget / (1024 * 1024) << " MiB budget\n";
+        warnedHeaps = over ? warnedHeaps | bit : warnedHeaps & ~bit;
+    }
+}
+
+std::vector<MemoryTelemetry::HeapStats> MemoryTelemetry::getHeapStats() const {
+    const VkPhysicalDeviceMemoryProperties* properties{nullptr};
+    vmaGetMemoryProperties(allocator, &properties);
+    std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+    vmaGetHeapBudgets(allocator, budgets.data());
+    // walks every block, fine for reports but not something to do every frame
+    VmaTotalStatistics total{};
+    vmaCalculateStatistics(allocator, &total);
+
+    std::vector<HeapStats> heaps{};
+    for (uint32_t heap{}; heap < properties->memoryHeapCount; heap++) {
+        const auto& detailed = total.memoryHeap[heap];
+        HeapStats stats{};
+        stats.heapIndex = heap;
+        stats.deviceLocal = properties->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        stats.usage = budgets[heap].usage;
+        stats.budget = budgets[heap].budget;
+        stats.blockBytes = detailed.statistics.blockBytes;
+        stats.allocationBytes = detailed.statistics.allocationBytes;
+        stats.blockCount = detailed.statistics.blockCount;
+        stats.allocationCount = detailed.statistics.allocationCount;
+        if (stats.blockBytes > 0)
+            stats.fragmentation = 1.0 - static_cast<double>(stats.allocationBytes) / stats.blockBytes;
+        // VMA reports VK_WHOLE_SIZE when a heap has no unused range
+        stats.largestUnusedRange = detailed.unusedRangeCount > 0 ? detailed.unusedRangeSizeMax : 0;
+        heaps.push_back(stats);
+    }
+    return heaps;
+}
+
+MemoryTelemetry::CategoryStats MemoryTelemetry::getCategoryStats(Category category) const {
+    std::lock_guard lock{mutex};
+    return categories[static_cast<size_t>(category)];
+}
+
+const char* MemoryTelemetry::getCategoryName(Category category) {
+    switch (category) {
+        case Category::Geometry:
+            return "geometry";
+        case Category::Textures:
+            return "textures";
+        case Category::RenderTargets:
+            return "render targets";
+        case Category::Staging:
+            return "staging";
+        case Category::Uniforms:
+            return "uniforms";
+        default:
+            return "unknown";
+    }
+}
+
+void MemoryTelemetry::writeJson(const std::string& path) const {
+    std::ofstream file{path, std::ios::trunc};
+    if (!file.is_open()) {
+        std::cout << "failed to open memory stats " << path << "\n";
+        return;
+    }
+    file << "{\n  \"frame\": " << frameCounter << ",\n  \"budget_extension\": " << (budgetExtension ? "true" : "false")
+         << ",\n  \"heaps\": [";
+    auto heaps = getHeapStats();
+    for (size_t i{}; i < heaps.size(); i++) {
+        const auto& heap = heaps[i];
+        file << (i ? "," : "") << "\n    {\"index\": " << heap.heapIndex << ", \"device_local\": " << (heap.deviceLocal ? "true" : "false")
+             << ", \"usage\": " << heap.usage << ", \"budget\": " << heap.budget << ", \"block_bytes\": " << heap.blockBytes
+             << ", \"allocation_bytes\": " << heap.allocationBytes << ", \"blocks\": " << heap.blockCount
+             << ", \"allocations\": " << heap.allocationCount << ", \"fragmentation\": " << heap.fragmentation
+             << ", \"largest_unused_range\": " << heap.largestUnusedRange << "}";
+    }
+    file << "\n  ],\n  \"categories\": [";
+    for (size_t i{}; i < categories.size(); i++) {
+        auto category = static_cast<Category>(i);
+        auto stats = getCategoryStats(category);
+        file << (i ? "," : "") << "\n    {\"name\": \"" << getCategoryName(category) << "\", \"bytes\": " << stats.bytes
+             << ", \"peak_bytes\": " << stats.peakBytes << ", \"allocations\": " << stats.count << "}";
+    }
+    // the stats string is a json object of its own with every block and allocation
+    char* statsString{nullptr};
+    vmaBuildStatsString(allocator, &statsString, VK_TRUE);
+    file << "\n  ],\n  \"vma\": " << statsString << "\n}\n";
+    vmaFreeStatsString(allocator, statsString);
+}
+
+void MemoryTelemetry::dump() const {
+    writeJson(dumpPath);
+}
+
+void MemoryTelemetry::printStats() const {
+    std::cout << "device memory:\n";
+    for (const auto& heap : getHeapStats())
+        std::cout << "  heap " << heap.heapIndex << (heap.deviceLocal ? " (device local)" : "") << ": "
+                  << heap.usage / (1024.0 * 1024.0) << " of " << heap.budget / (1024.0 * 1024.0) << " MiB, "
+                  << heap.allocationCount << " allocations in " << heap.blockCount << " blocks, "
+                  << heap.fragmentation * 100.0 << "% unused\n";
+    for (size_t i{}; i < categories.size(); i++) {
+        auto category = static_cast<Category>(i);
+        auto stats = getCategoryStats(category);
+        std::cout << "  " << getCategoryName(category) << ": " << stats.bytes / (1024.0 * 1024.0) << " MiB in "
+                  << stats.count << " allocations, peak " << stats.peakBytes / (1024.0 * 1024.0) << " MiB\n";
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "commonIncludes.h"
+#include "vma/vk_mem_alloc.h"
+#include <array>
+#include <mutex>
+#include <unordered_map>
+
+// every VMA allocation is tagged with what it is used for, so the device memory
+// can be broken down by category next to the per heap budget the driver reports.
+// allocations have to be freed through free() for the category totals to stay right
+class MemoryTelemetry {
+  public:
+    enum class Category {
+        Geometry,
+        Textures,
+        RenderTargets,
+        Staging,
+        Uniforms,
+        Count
+    };
+
+    struct HeapStats {
+        uint32_t heapIndex{};
+        bool deviceLocal{};
+        // usage and budget of the whole process, other allocators included
+        VkDeviceSize usage{};
+        VkDeviceSize budget{};
+        VkDeviceSize blockBytes{};
+        VkDeviceSize allocationBytes{};
+        uint32_t blockCount{};
+        uint32_t allocationCount{};
+        // share of the block bytes no allocation covers
+        double fragmentation{};
+        VkDeviceSize largestUnusedRange{};
+    };
+
+    struct CategoryStats {
+        VkDeviceSize bytes{};
+        VkDeviceSize peakBytes{};
+        uint32_t count{};
+    };
+
+    // the allocator is not owned, it has to outlive every allocation freed through here
+    void init(VmaAllocator allocator, bool budgetExtension, const std::string& dumpPath = {});
+    // safe to call from any thread
+    void track(VmaAllocation allocation, Category category);
+    // untracks and frees, a null allocation is ignored like vmaFreeMemory does
+    void free(VmaAllocation allocation);
+    // once per frame, lets VMA refresh the budget and dumps every dumpInterval frames
+    void nextFrame();
+    std::vector<HeapStats> getHeapStats() const;
+    CategoryStats getCategoryStats(Category category) const;
+    static const char* getCategoryName(Category category);
+    // our summary next to the full vmaBuildStatsString map
+    void writeJson(const std::string& path) const;
+    void dump() const;
+    void printStats() const;
+
+  private:
+    static constexpr uint64_t dumpInterval{600};
+    // warns about a heap once it uses this share of its budget
+    static constexpr double budgetWarning{0.9};
+
+    VmaAllocator allocator{};
+    bool budgetExtension{false};
+    std::string dumpPath{};
+    uint32_t frameCounter{};
+    uint32_t warnedHeaps{};
+    mutable std::mutex mutex{};
+    std::unordered_map<VmaAllocation, std::pair<Category, VkDeviceSize>> allocations{};
+    std::array<CategoryStats, static_cast<size_t>(Category::Count)> categories{};
+
+    void checkBudget();
+};
@@ -0,0 +1,91 @@
+#include "MeshCache.h"
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+std::string MeshCache::getCachePath(const std::string& sourceName, bool customUV) {
+    // the uv remap changes the vertices so it gets a file of its own
+    auto fileName = std::filesystem::path{sourceName}.filename().string();
+    return (std::filesystem::path{cacheDirectory} / (fileName + (customUV ? ".uv.mesh" : ".mesh"))).string();
+}
+
+bool MeshCache::makeHeader(const std::string& sourceName, bool customUV, Header& header) {
+    std::error_code error{};
+    header.sourceSize = std::filesystem::file_size(sourceName, error);
+    if (error)
+        return false;
+    header.sourceWriteTime = std::filesystem::last_write_time(sourceName, error).time_since_epoch().count();
+    if (error)
+        return false;
+    header.customUV = customUV ? 1 : 0;
+    header.vertexStride = sizeof(Resources::Vertex);
+    return true;
+}
+
+bool MeshCache::load(const std::string& sourceName, bool customUV, Resources::ModelData& model) {
+    Header expected{};
+    if (!makeHeader(sourceName, customUV, expected))
+        return false;
+
+    const std::string path{getCachePath(sourceName, customUV)};
+    std::ifstream file{path, std::ios::binary};
+    if (!file.is_open())
+        return false;
+
+    Header header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != expected.magic || header.version != expected.version || header.sourceSize != expected.sourceSize || header.sourceWriteTime != expected.sourceWriteTime || header.customUV != expected.customUV || header.vertexStride != expected.vertexStride)
+        return false;
+
+    // the counts come from the file, a truncated or corrupt one must not get to
+    // size the allocations below
+    std::error_code error{};
+    uint64_t expectedSize{sizeof(Header) + uint64_t{header.vertexCount} * sizeof(Resources::Vertex) + uint64_t{header.indexCount} * sizeof(uint32_t)};
+    if (std::filesystem::file_size(path, error) != expectedSize || error)
+        return false;
+
+    // the streams are read straight into the arrays the upload copies from
+    model.vertices.resize(header.vertexCount);
+    model.indices.resize(header.indexCount);
+    file.read(reinterpret_cast<char*>(model.vertices.data()), static_cast<std::streamsize>(header.vertexCount) * sizeof(Resources::Vertex));
+    file.read(reinterpret_cast<char*>(model.indices.data()), static_cast<std::streamsize>(header.indexCount) * sizeof(uint32_t));
+    // an index past the vertices would make the gpu fetch out of range, the mesh is cooked again
+    bool indicesValid{std::all_of(model.indices.begin(), model.indices.end(), [&header](uint32_t index) { return index < header.vertexCount; })};
+    if (!file || !indicesValid) {
+        model = {};
+        return false;
+    }
+    return true;
+}
+
+void MeshCache::store(const std::string& sourceName, bool customUV, const Resources::ModelData& model) {
+    Header header{};
+    if (!makeHeader(sourceName, customUV, header))
+        return;
+    header.vertexCount = static_cast<uint32_t>(model.vertices.size());
+    header.indexCount = static_cast<uint32_t>(model.indices.size());
+
+    std::error_code error{};
+    std::filesystem::create_directories(cacheDirectory, error);
+    // models are cooked on the loader threads, the temporary name has to be unique per thread
+    const std::string path{getCachePath(sourceName, customUV)};
+    const std::string tempName{path + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp"};
+    {
+        std::ofstream file{tempName, std::ios::binary | std::ios::trunc};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(model.vertices.data()), static_cast<std::streamsize>(model.vertices.size()) * sizeof(Resources::Vertex));
+        file.write(reinterpret_cast<const char*>(model.indices.data()), static_cast<std::streamsize>(model.indices.size()) * sizeof(uint32_t));
+        file.flush();
+        if (!file) {
+            std::cout << "failed to write mesh cache " << tempName << "\n";
+            return;
+        }
+    }
+
+    std::filesystem::rename(tempName, path, error);
+    if (error) {
+        std::cout << "failed to replace mesh cache " << path << ": " << error.message() << "\n";
+        std::filesystem::remove(tempName, error);
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "Resources.h"
+#include <array>
+
+// cooked meshes on disk so warm starts skip assimp and the mesh optimizer,
+// a file is a fixed header followed by the vertex and the index stream and
+// is only used while the source model's size and write time still match
+class MeshCache {
+  public:
+    static bool load(const std::string& sourceName, bool customUV, Resources::ModelData& model);
+    static void store(const std::string& sourceName, bool customUV, const Resources::ModelData& model);
+
+  private:
+    struct Header {
+        std::array<char, 4> magic{'V', 'M', 'S', 'H'};
+        uint32_t version{1};
+        uint64_t sourceSize{};
+        int64_t sourceWriteTime{};
+        uint32_t customUV{};
+        uint32_t vertexStride{};
+        uint32_t vertexCount{};
+        uint32_t indexCount{};
+    };
+
+    static constexpr const char* cacheDirectory{"mesh_cache"};
+    static std::string getCachePath(const std::string& sourceName, bool customUV);
+    static bool makeHeader(const std::string& sourceName, bool customUV, Header& header);
+};
@@ -0,0 +1,207 @@
+#include "MeshOptimizer.h"
+#include <cmath>
+#include <cstring>
+#include <deque>
+
+MeshOptimizer::Stats MeshOptimizer::optimize(std::vector<Resources::Vertex>& vertices, std::vector<uint32_t>& indices) {
+    Stats stats{};
+    stats.verticesBefore = vertices.size();
+    stats.acmrBefore = computeACMR(indices, vertices.size());
+
+    weldVertices(vertices, indices);
+    optimizeVertexCache(indices, vertices.size());
+    optimizeVertexFetch(vertices, indices);
+
+    stats.verticesAfter = vertices.size();
+    stats.acmrAfter = computeACMR(indices, vertices.size());
+    return stats;
+}
+
+void MeshOptimizer::weldVertices(std::vector<Resources::Vertex>& vertices, std::vector<uint32_t>& indices) {
+    // open addressing on the raw bytes, the vertex has no padding so two
+    // vertices are identical exactly when their bytes are
+    static_assert(sizeof(Resources::Vertex) == sizeof(float) * 8);
+    size_t tableSize{1};
+    while (tableSize < vertices.size() * 2)
+        tableSize *= 2;
+    const uint32_t empty{UINT32_MAX};
+    std::vector<uint32_t> table(tableSize, empty);
+    std::vector<uint32_t> remap(vertices.size());
+    std::vector<Resources::Vertex> unique{};
+    unique.reserve(vertices.size());
+
+    for (size_t index{}; index < vertices.size(); index++) {
+        const auto* bytes = reinterpret_cast<const unsigned char*>(&vertices[index]);
+        // fnv-1a
+        uint64_t hash{14695981039346656037ull};
+        for (size_t byte{}; byte < sizeof(Resources::Vertex); byte++)
+            hash = (hash ^ bytes[byte]) * 1099511628211ull;
+
+        size_t slot{hash & (tableSize - 1)};
+        while (table[slot] != empty && std::memcmp(&unique[table[slot]], &vertices[index], sizeof(Resources::Vertex)) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+        if (table[slot] == empty) {
+            table[slot] = static_cast<uint32_t>(unique.size());
+            unique.push_back(vertices[index]);
+        }
+        remap[index] = table[slot];
+    }
+
+    for (auto& index : indices)
+        index = remap[index];
+    vertices = std::move(unique);
+}
+
+float MeshOptimizer::getVertexScore(int32_t cachePosition, uint32_t remainingTriangles) {
+    if (remainingTriangles == 0)
+        return -1.0f;
+
+    float score{};
+    if (cachePosition >= 0) {
+        // the last triangle's vertices score the same so the next one isn't
+        // pushed towards reusing a particular edge
+        if (cachePosition < 3)
+            score = 0.75f;
+        else
+            score = std::pow(1.0f - static_cast<float>(cachePosition - 3) / (cacheSize - 3), 1.5f);
+    }
+    // vertices with few triangles left are finished first so they leave the cache for good
+    score += 2.0f * std::pow(static_cast<float>(remainingTriangles), -0.5f);
+    return score;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+    const size_t triangleCount{indices.size() / 3};
+    if (triangleCount == 0)
+        return;
+
+    // for every vertex the triangles that still have to be emitted, the live
+    // ones are kept at the front of each vertex's range
+    std::vector<uint32_t> remaining(vertexCount);
+    for (auto index : indices)
+        remaining[index]++;
+    std::vector<uint32_t> offsets(vertexCount + 1);
+    for (size_t vertex{}; vertex < vertexCount; vertex++)
+        offsets[vertex + 1] = offsets[vertex] + remaining[vertex];
+    std::vector<uint32_t> vertexTriangles(indices.size());
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t index{}; index < indices.size(); index++)
+            vertexTriangles[cursor[indices[index]]++] = static_cast<uint32_t>(index / 3);
+    }
+
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t vertex{}; vertex < vertexCount; vertex++)
+        vertexScores[vertex] = getVertexScore(-1, remaining[vertex]);
+    std::vector<float> triangleScores(triangleCount);
+    for (size_t triangle{}; triangle < triangleCount; triangle++)
+        for (size_t corner{}; corner < 3; corner++)
+            triangleScores[triangle] += vertexScores[indices[triangle * 3 + corner]];
+
+    const size_t none{SIZE_MAX};
+    size_t bestTriangle{static_cast<size_t>(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin())};
+    std::vector<bool> emitted(triangleCount);
+    size_t scanCursor{};
+    std::vector<uint32_t> cache{};
+    std::vector<uint32_t> nextCache{};
+    std::vector<uint32_t> output{};
+    output.reserve(indices.size());
+
+    for (size_t emittedCount{}; emittedCount < triangleCount; emittedCount++) {
+        // nothing in the cache has triangles left, continue with the next one in the old order
+        if (bestTriangle == none) {
+            while (emitted[scanCursor])
+                scanCursor++;
+            bestTriangle = scanCursor;
+        }
+
+        const uint32_t* corners{&indices[bestTriangle * 3]};
+        output.insert(output.end(), corners, corners + 3);
+        emitted[bestTriangle] = true;
+
+        nextCache.clear();
+        for (size_t corner{}; corner < 3; corner++) {
+            uint32_t vertex{corners[corner]};
+            uint32_t* begin{&vertexTriangles[offsets[vertex]]};
+            uint32_t* end{begin + remaining[vertex]};
+            std::swap(*std::find(begin, end, static_cast<uint32_t>(bestTriangle)), *(end - 1));
+            remaining[vertex]--;
+            if (std::find(nextCache.begin(), nextCache.end(), vertex) == nextCache.end())
+                nextCache.push_back(vertex);
+        }
+        for (auto vertex : cache) {
+            if (std::find(nextCache.begin(), nextCache.end(), vertex) == nextCache.end())
+                nextCache.push_back(vertex);
+        }
+
+        // vertices past the end are the ones that just fell out of the cache,
+        // they still need their score lowered
+        for (size_t position{}; position < nextCache.size(); position++) {
+            uint32_t vertex{nextCache[position]};
+            int32_t cachePosition{position < static_cast<size_t>(cacheSize) ? static_cast<int32_t>(position) : -1};
+            float score{getVertexScore(cachePosition, remaining[vertex])};
+            float delta{score - vertexScores[vertex]};
+            vertexScores[vertex] = score;
+            for (uint32_t triangle{}; triangle < remaining[vertex]; triangle++)
+                triangleScores[vertexTriangles[offsets[vertex] + triangle]] += delta;
+        }
+        if (nextCache.size() > static_cast<size_t>(cacheSize))
+            nextCache.resize(cacheSize);
+        std::swap(cache, nextCache);
+
+        bestTriangle = none;
+        float bestScore{-1.0f};
+        for (auto vertex : cache) {
+            for (uint32_t triangle{}; triangle < remaining[vertex]; triangle++) {
+                uint32_t candidate{vertexTriangles[offsets[vertex] + triangle]};
+                if (triangleScores[candidate] > bestScore) {
+                    bestScore = triangleScores[candidate];
+                    bestTriangle = candidate;
+                }
+            }
+        }
+    }
+    indices = std::move(output);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Resources::Vertex>& vertices, std::vector<uint32_t>& indices) {
+    // vertices are renumbered in the order the index buffer first uses them,
+    // vertices no triangle references are dropped on the way
+    const uint32_t unused{UINT32_MAX};
+    std::vector<uint32_t> remap(vertices.size(), unused);
+    uint32_t nextVertex{};
+    for (auto& index : indices) {
+        if (remap[index] == unused)
+            remap[index] = nextVertex++;
+        index = remap[index];
+    }
+
+    std::vector<Resources::Vertex> reordered(nextVertex);
+    for (size_t vertex{}; vertex < vertices.size(); vertex++) {
+        if (remap[vertex] != unused)
+            reordered[remap[vertex]] = vertices[vertex];
+    }
+    vertices = std::move(reordered);
+}
+
+float MeshOptimizer::computeACMR(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) {
+    if (indices.size() < 3)
+        return 0.0f;
+
+    // a plain fifo is close enough to what post transform caches do
+    std::vector<bool> cached(vertexCount);
+    std::deque<uint32_t> fifo{};
+    size_t misses{};
+    for (auto index : indices) {
+        if (cached[index])
+            continue;
+        misses++;
+        cached[index] = true;
+        fifo.push_back(index);
+        if (fifo.size() > cacheSize) {
+            cached[fifo.front()] = false;
+            fifo.pop_front();
+        }
+    }
+    return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "Resources.h"
+
+// cpu side mesh processing that runs between importing a model and
+// uploading it, every step keeps the mesh rendering exactly the same
+class MeshOptimizer {
+  public:
+    using Stats = Resources::MeshStats;
+
+    // welds, reorders the triangles for the vertex cache and then the
+    // vertices for fetch locality
+    static Stats optimize(std::vector<Resources::Vertex>& vertices, std::vector<uint32_t>& indices);
+    static void weldVertices(std::vector<Resources::Vertex>& vertices, std::vector<uint32_t>& indices);
+    // Tom Forsyth's linear speed vertex cache optimisation
+    static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+    static void optimizeVertexFetch(std::vector<Resources::Vertex>& vertices, std::vector<uint32_t>& indices);
+    static float computeACMR(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = 16);
+
+  private:
+    static constexpr int32_t cacheSize{32};
+    static float getVertexScore(int32_t cachePosition, uint32_t remainingTriangles);
+};
@@ -0,0 +1,78 @@
+#include "ParallelRecorder.h"
+#include "PresentationEngine.h"
+#include "Renderer.h"
+
+ParallelRecorder::ParallelRecorder(Renderer& renderer, uint32_t chunkCount)
+    : m_renderer{renderer}
+    , chunkCount{std::max(chunkCount, 1u)} {
+    vk::CommandPoolCreateInfo poolInfo{};
+    poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
+    poolInfo.queueFamilyIndex = m_renderer.getQueueFamilyIndex();
+
+    frames.resize(m_renderer.framesInFlight);
+    for (auto& chunks : frames) {
+        chunks.resize(this->chunkCount);
+        for (auto& chunk : chunks) {
+            chunk.pool = m_renderer.m_device.createCommandPool(poolInfo);
+            vk::CommandBufferAllocateInfo allocInfo{};
+            allocInfo.commandPool = *chunk.pool;
+            allocInfo.level = vk::CommandBufferLevel::eSecondary;
+            allocInfo.commandBufferCount = 1;
+            vk::raii::CommandBuffers commandBuffers{m_renderer.m_device, allocInfo};
+            chunk.commandBuffer = std::move(commandBuffers[0]);
+        }
+    }
+}
+
+void ParallelRecorder::record(vk::raii::CommandBuffer& primary, uint32_t frameIndex, const RecordChunk& recordChunk) {
+    auto& chunks = frames[frameIndex];
+    // the main thread records the first chunk itself instead of waiting idle
+    std::vector<std::future<void>> tasks{};
+    for (uint32_t index{1}; index < chunkCount; index++)
+        tasks.push_back(m_renderer.threadPool.submit([this, &chunks, index, &recordChunk] { recordSecondary(chunks[index], index, recordChunk); }));
+    std::exception_ptr error{};
+    try {
+        recordSecondary(chunks[0], 0, recordChunk);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    // every task has to be done before anything throws, they reference this frame's chunks
+    for (auto& task : tasks)
+        task.wait();
+    if (error)
+        std::rethrow_exception(error);
+    for (auto& task : tasks)
+        task.get();
+
+    std::vector<vk::CommandBuffer> commandBuffers{};
+    for (auto& chunk : chunks)
+        commandBuffers.push_back(*chunk.commandBuffer);
+    primary.executeCommands(commandBuffers);
+}
+
+void ParallelRecorder::recordSecondary(Chunk& chunk, uint32_t chunkIndex, const RecordChunk& recordChunk) {
+    // the frame's fence was waited on before recording started so its pools are idle
+    chunk.pool.reset();
+
+    vk::Format colorFormat{m_renderer.pEngine->swapChainImagesFormat};
+    vk::CommandBufferInheritanceRenderingInfo renderingInfo{};
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachmentFormats = &colorFormat;
+    renderingInfo.depthAttachmentFormat = vk::Format::eD32Sfloat;
+    renderingInfo.rasterizationSamples = vk::SampleCountFlagBits::e1;
+
+    vk::CommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.pNext = &renderingInfo;
+
+    vk::CommandBufferBeginInfo beginInfo{};
+    beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    chunk.commandBuffer.begin(beginInfo);
+    recordChunk(chunk.commandBuffer, chunkIndex, chunkCount);
+    chunk.commandBuffer.end();
+}
+
+uint32_t ParallelRecorder::getChunkCount() const {
+    return chunkCount;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "commonIncludes.h"
+#include <functional>
+
+class Renderer;
+// splits the draws inside a rendering scope into chunks that are recorded
+// into secondary command buffers in parallel, every chunk of every frame in
+// flight has its own pool so no two threads ever share one and a frame's
+// pools are reset as a whole once its fence has signaled
+class ParallelRecorder {
+  public:
+    using RecordChunk = std::function<void(vk::raii::CommandBuffer& commandBuffer, uint32_t chunk, uint32_t chunkCount)>;
+
+    ParallelRecorder(Renderer& renderer, uint32_t chunkCount);
+    ParallelRecorder(const ParallelRecorder&) = delete;
+    ParallelRecorder& operator=(const ParallelRecorder&) = delete;
+
+    // records every chunk and executes them in chunk order, the primary has to
+    // be inside a beginRendering started with eContentsSecondaryCommandBuffers
+    void record(vk::raii::CommandBuffer& primary, uint32_t frameIndex, const RecordChunk& recordChunk);
+    uint32_t getChunkCount() const;
+
+  private:
+    struct Chunk {
+        vk::raii::CommandPool pool{nullptr};
+        vk::raii::CommandBuffer commandBuffer{nullptr};
+    };
+
+    Renderer& m_renderer;
+    uint32_t chunkCount{};
+    std::vector<std::vector<Chunk>> frames{};
+
+    void recordSecondary(Chunk& chunk, uint32_t chunkIndex, const RecordChunk& recordChunk);
+};
@@ -0,0 +1,137 @@
+#include "PipelineCache.h"
+#include "Renderer.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+PipelineCache::PipelineCache(Renderer& renderer, const std::string& fileName)
+    : m_renderer{renderer}
+    , fileName{fileName} {
+    auto data = readCacheFile();
+    if (!data.empty() && !isCacheDataValid(data)) {
+        std::cout << "pipeline cache " << fileName << " belongs to another device or driver, starting empty\n";
+        data.clear();
+    }
+
+    vk::PipelineCacheCreateInfo createInfo{};
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.data();
+    cache = m_renderer.m_device.createPipelineCache(createInfo);
+    loadedBytes = data.size();
+}
+
+std::vector<char> PipelineCache::readCacheFile() {
+    std::ifstream file{fileName, std::ios::ate | std::ios::binary};
+    if (!file.is_open())
+        return {};
+
+    std::vector<char> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(data.data(), data.size());
+    if (!file)
+        return {};
+    return data;
+}
+
+bool PipelineCache::isCacheDataValid(const std::vector<char>& data) {
+    VkPipelineCacheHeaderVersionOne header{};
+    if (data.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    // drivers are supposed to reject foreign data themselves but not all of
+    // them do, a blob from another gpu can crash pipeline creation
+    auto properties = m_renderer.m_physicalDevice.getProperties();
+    if (header.headerSize < sizeof(header) || header.headerSize > data.size())
+        return false;
+    if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+        return false;
+    if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID)
+        return false;
+    return std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+}
+
+vk::raii::Pipeline PipelineCache::createGraphicsPipeline(vk::GraphicsPipelineCreateInfo pipelineInfo) {
+    vk::PipelineCreationFeedback feedback{};
+    std::vector<vk::PipelineCreationFeedback> stageFeedbacks(pipelineInfo.stageCount);
+    vk::PipelineCreationFeedbackCreateInfo feedbackInfo{};
+    feedbackInfo.pPipelineCreationFeedback = &feedback;
+    feedbackInfo.pipelineStageCreationFeedbackCount = static_cast<uint32_t>(stageFeedbacks.size());
+    feedbackInfo.pPipelineStageCreationFeedbacks = stageFeedbacks.data();
+    feedbackInfo.pNext = pipelineInfo.pNext;
+    pipelineInfo.pNext = &feedbackInfo;
+
+    auto pipeline = m_renderer.m_device.createGraphicsPipeline(cache, pipelineInfo);
+    recordFeedback(feedback);
+    return pipeline;
+}
+
+vk::raii::Pipeline PipelineCache::createComputePipeline(vk::ComputePipelineCreateInfo pipelineInfo) {
+    vk::PipelineCreationFeedback feedback{};
+    vk::PipelineCreationFeedback stageFeedback{};
+    vk::PipelineCreationFeedbackCreateInfo feedbackInfo{};
+    feedbackInfo.pPipelineCreationFeedback = &feedback;
+    feedbackInfo.pipelineStageCreationFeedbackCount = 1;
+    feedbackInfo.pPipelineStageCreationFeedbacks = &stageFeedback;
+    feedbackInfo.pNext = pipelineInfo.pNext;
+    pipelineInfo.pNext = &feedbackInfo;
+
+    auto pipeline = m_renderer.m_device.createComputePipeline(cache, pipelineInfo);
+    recordFeedback(feedback);
+    return pipeline;
+}
+
+void PipelineCache::recordFeedback(const vk::PipelineCreationFeedback& feedback) {
+    if (!(feedback.flags & vk::PipelineCreationFeedbackFlagBits::eValid))
+        unknown++;
+    else if (feedback.flags & vk::PipelineCreationFeedbackFlagBits::eApplicationPipelineCacheHit)
+        hits++;
+    else
+        misses++;
+}
+
+void PipelineCache::save() {
+    auto data = cache.getData();
+    if (data.empty())
+        return;
+
+    // write everything next to the real file first and swap it in afterwards,
+    // rename replaces the old cache in one step
+    const std::string tempName{fileName + ".tmp"};
+    {
+        std::ofstream file{tempName, std::ios::binary | std::ios::trunc};
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        file.flush();
+        if (!file) {
+            std::cout << "failed to write pipeline cache " << tempName << "\n";
+            return;
+        }
+    }
+
+    std::error_code error{};
+    std::filesystem::rename(tempName, fileName, error);
+    if (error) {
+        std::cout << "failed to replace pipeline cache " << fileName << ": " << error.message() << "\n";
+        std::filesystem::remove(tempName, error);
+        return;
+    }
+    savedBytes = data.size();
+}
+
+PipelineCache::Stats PipelineCache::getStats() const {
+    Stats stats{};
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.unknown = unknown;
+    stats.loadedBytes = loadedBytes;
+    stats.savedBytes = savedBytes;
+    return stats;
+}
+
+void PipelineCache::printStats() const {
+    auto stats = getStats();
+    std::cout << "pipeline cache: " << stats.hits << " hits, " << stats.misses << " misses";
+    if (stats.unknown)
+        std::cout << ", " << stats.unknown << " without feedback";
+    std::cout << ", loaded " << stats.loadedBytes << " bytes, saved " << stats.savedBytes << " bytes\n";
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "commonIncludes.h"
+#include <atomic>
+
+class Renderer;
+// a VkPipelineCache that survives between runs, the file is only used when its
+// header matches the current device and every save goes through a temporary
+// file so a crash can never leave a half written cache behind
+class PipelineCache {
+  public:
+    struct Stats {
+        uint64_t hits{};
+        uint64_t misses{};
+        // pipelines where the driver gave no creation feedback
+        uint64_t unknown{};
+        size_t loadedBytes{};
+        size_t savedBytes{};
+    };
+
+    PipelineCache(Renderer& renderer, const std::string& fileName = "pipeline_cache.bin");
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    // both are safe to call from several threads at once
+    vk::raii::Pipeline createGraphicsPipeline(vk::GraphicsPipelineCreateInfo pipelineInfo);
+    vk::raii::Pipeline createComputePipeline(vk::ComputePipelineCreateInfo pipelineInfo);
+    void save();
+    Stats getStats() const;
+    void printStats() const;
+
+  private:
+    Renderer& m_renderer;
+    std::string fileName{};
+    vk::raii::PipelineCache cache{nullptr};
+    std::atomic<uint64_t> hits{};
+    std::atomic<uint64_t> misses{};
+    std::atomic<uint64_t> unknown{};
+    size_t loadedBytes{};
+    size_t savedBytes{};
+
+    std::vector<char> readCacheFile();
+    bool isCacheDataValid(const std::vector<char>& data);
+    void recordFeedback(const vk::PipelineCreationFeedback& feedback);
+};
@@ -80,6 +80,11 @@ PresentationEngine::PresentationEngine(Renderer& renderer)
     : m_renderer{renderer} {
 }
 
+PresentationEngine::~PresentationEngine() {
+    blitImageViews.clear();
+    destroyBlitImage();
+}
+
 void PresentationEngine::createSurface() {
     // you have to give glfwCreatewindowSurface a vkSurface handle
     VkSurfaceKHR c_surface{};
@@ -129,8 +134,18 @@ void PresentationEngine::createSwapchain() {
     swapChainExtent = extent;
 }
 
+void PresentationEngine::createHeadlessTarget() {
+    // without a surface there is nothing to query, so the blit image just
+    // takes the window size and the format we would prefer from a swapchain
+    swapChainImagesFormat = vk::Format::eR8G8B8A8Srgb;
+    swapChainExtent = vk::Extent2D{static_cast<uint32_t>(m_renderer.width),
+        static_cast<uint32_t>(m_renderer.height)};
+}
+
 void PresentationEngine::createSwapchainImages() {
     swapChainImages = m_swapChain.getImages();
+    for (const auto& image : swapChainImages)
+        m_renderer.stateTracker.registerImage(image, vk::ImageAspectFlagBits::eColor);
 }
 
 void PresentationEngine::createBlitImage() {
@@ -150,17 +165,23 @@ void PresentationEngine::createBlitImage() {
     imageInfo.sharingMode = vk::SharingMode::eExclusive;
     imageInfo.samples = vk::SampleCountFlagBits::e1;
 
-    blitImage = m_renderer.m_device.createImage(imageInfo);
-
-     vk::MemoryRequirements memRequirements;
-    memRequirements = blitImage.getMemoryRequirements();
-
-    vk::MemoryAllocateInfo allocInfo{};
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = m_renderer.pResources->findMemoryType(memRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
-    blitImageMemory = m_renderer.m_device.allocateMemory(allocInfo);
+    // initVulkan creates it twice, the first one has to go before it is replaced
+    destroyBlitImage();
+    vk::Image image{};
+    VmaAllocationCreateInfo allocInfo{};
+    allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    if (vmaCreateImage(m_renderer.allocator, reinterpret_cast<VkImageCreateInfo*>(&imageInfo), &allocInfo, reinterpret_cast<VkImage*>(&image), &blitImageAlloc, nullptr) != VK_SUCCESS)
+        throw std::runtime_error("failed to create the blit image");
+    m_renderer.memoryTelemetry.track(blitImageAlloc, MemoryTelemetry::Category::RenderTargets);
+    blitImage = vk::raii::Image{m_renderer.m_device, image};
+    m_renderer.stateTracker.registerImage(*blitImage, vk::ImageAspectFlagBits::eColor);
+}
 
-    blitImage.bindMemory(*blitImageMemory, 0);
+void PresentationEngine::destroyBlitImage() {
+    blitImage.clear();
+    m_renderer.memoryTelemetry.free(blitImageAlloc);
+    blitImageAlloc = nullptr;
 }
 
 void PresentationEngine::createBlitImageView() {
@@ -1,6 +1,7 @@
 #pragma once
 class Renderer;
 #include "commonIncludes.h"
+#include "vma/vk_mem_alloc.h"
 class PresentationEngine {
   public:
     struct SwapChainCapablities {
@@ -17,16 +18,19 @@ class PresentationEngine {
     std::vector<vk::raii::ImageView> swapChainImageViews{};
 
     vk::raii::Image blitImage{nullptr};
-    vk::raii::DeviceMemory blitImageMemory{nullptr};
+    VmaAllocation blitImageAlloc{nullptr};
     vk::raii::ImageView blitImageViews{nullptr};
 
     PresentationEngine(Renderer& renderer);
+    ~PresentationEngine();
     void createSurface();
     void createSwapchain();
+    void createHeadlessTarget();
     void createSwapchainImages();
     void createImageViews();
     void createBlitImage();
     void createBlitImageView();
+    void destroyBlitImage();
 
   private:
     Renderer& m_renderer;
@@ -2,20 +2,37 @@
 #include "Graphics.h"
 #include "PresentationEngine.h"
 #include "Resources.h"
+#include "ScreenCapture.h"
+#include "GpuCulling.h"
+#include "CpuCulling.h"
+#include "ParallelRecorder.h"
+#include "PipelineCache.h"
+#include "GpuProfiler.h"
+#include "Benchmark.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <chrono>
+#include <charconv>
 #include <stb_image.h>
-#include <stb_image_write.h>
 void Renderer::run(PresentationEngine* engine, Graphics* Graphics, Resources* resources) {
     pEngine = engine;
     pGraphics = Graphics;
     pResources = resources;
+    if (cullBenchmark) {
+        CpuCulling::runBenchmark();
+        return;
+    }
     createRandomNumberGenerator();
-    initWindow();
+    if (!headless)
+        initWindow();
     initVulkan();
     mainLoop();
+    // the resources are gone by the time the renderer is destroyed
+    pResources->stagingRing->printStats();
+    memoryTelemetry.printStats();
+    if (!memoryStatsPath.empty())
+        memoryTelemetry.dump();
 }
 
 void Renderer::initWindow() {
@@ -29,28 +46,48 @@ void Renderer::initWindow() {
 }
 
 void Renderer::initVulkan() {
+    PROFILE_ZONE("initVulkan");
     createInstance();
     setupDebugCallback();
-    pEngine->createSurface();
+    if (!headless)
+        pEngine->createSurface();
     createDevice();
     createAllocator();
-    pEngine->createSwapchain();
-    pEngine->createSwapchainImages();
-    pEngine->createImageViews();
+    pPipelineCache = std::make_unique<PipelineCache>(*this);
+    if (headless)
+        pEngine->createHeadlessTarget();
+    else {
+        pEngine->createSwapchain();
+        pEngine->createSwapchainImages();
+        pEngine->createImageViews();
+    }
     pEngine->createBlitImage();
     pEngine->createBlitImageView();
     pGraphics->createDescriptorLayout();
-    pGraphics->createGraphicsPipeline();
     pGraphics->createSkyBoxDescriptorLayout();
-    pGraphics->createSkyBoxPipeline();
+    pResources->createTextureTable();
+    if (gpuCulling)
+        pGraphics->createCullDescriptorLayout();
+    // the pipelines compile on the thread pool while the assets are loaded
+    pGraphics->startPipelineCompilation();
     pResources->createResources();
+    pResources->createGeometryHeap();
     pResources->createDescriptorPool();
-    pResources->createMesh("cube.obj", "statue.jpg", pResources->cube);
-    pResources->createMesh("viking_room.obj", "viking_room.png", pResources->viking);
-    pResources->createSkyBox();
-    pResources->createMesh("cube.obj", "LGOsa.jpg", pResources->atlasCube, true);
+    loadAssets();
     pResources->createInstanceData();
-    pResources->loadImage("kenergy.jpg", pResources->texImage3, pResources->texImageView3, pResources->texImageAlloc3, pResources->texSampler3);
+    if (recordThreads > 0)
+        pRecorder = std::make_unique<ParallelRecorder>(*this, recordThreads);
+    if (gpuCulling) {
+        pCulling = std::make_unique<GpuCulling>(*this, pResources->instances, pResources->viking);
+    } else if (cpuCulling) {
+        pCpuCulling = std::make_unique<CpuCulling>(pResources->instances, pResources->viking.boundingSphere);
+        pResources->createVisibleInstanceBuffers();
+        std::cout << "cpu culling uses the " << CpuCulling::getPathName(pCpuCulling->getPath()) << " path\n";
+    }
+    // every asset above was recorded into one upload batch, this is the only
+    // submit for all of them
+    pResources->submitUploads();
+    pResources->createStagingRing();
     pResources->allocateDescriptorSets();
     pResources->allocateSkyDescriptorSet();
     pEngine->createBlitImage();
@@ -58,11 +95,71 @@ void Renderer::initVulkan() {
     //pGraphics->createComputeDescriptorLayout();
     //pGraphics->createComputePipeline();
     //pResources->allocateComputeDescSet();
-    pResources->createDepthBuffer();
+    pFrameGraph = std::make_unique<FrameGraph>(*this);
+    if (gpuProfiling)
+        pGpuProfiler = std::make_unique<GpuProfiler>(*this, framesInFlight, gpuProfilePath);
+    pCapture = std::make_unique<ScreenCapture>(*this);
+    pGraphics->waitForPipelines();
     listExtensionNames();
 }
 
+void Renderer::loadAssets() {
+    PROFILE_ZONE("loadAssets");
+    // decoding is pure cpu work so every file goes to the thread pool up front,
+    // the gpu side is then created on this thread in the same order as before
+    auto start = std::chrono::high_resolution_clock::now();
+    auto cubeModel = threadPool.submit([this] { return pResources->decodeModel("cube.obj"); });
+    auto vikingModel = threadPool.submit([this] { return pResources->decodeModel("viking_room.obj"); });
+    auto atlasModel = threadPool.submit([this] { return pResources->decodeModel("cube.obj", true); });
+    auto statueImage = threadPool.submit([] { return Resources::decodeTexture("statue.jpg"); });
+    auto vikingImage = threadPool.submit([] { return Resources::decodeTexture("viking_room.png"); });
+    auto atlasImage = threadPool.submit([] { return Resources::decodeTexture("LGOsa.jpg"); });
+    auto kenergyImage = threadPool.submit([] { return Resources::decodeTexture("kenergy.jpg"); });
+    std::vector<std::future<Resources::ImageData>> faceImages{};
+    for (const auto& face : faces)
+        faceImages.push_back(threadPool.submit([&face] { return Resources::decodeImage(face); }));
+
+    // get() rethrows a failed decode
+    std::exception_ptr error{};
+    try {
+        pResources->createMesh(cubeModel.get(), statueImage.get(), pResources->cube);
+        pResources->createMesh(vikingModel.get(), vikingImage.get(), pResources->viking, compactVertices);
+        std::vector<Resources::ImageData> skyBoxFaces{};
+        for (auto& face : faceImages)
+            skyBoxFaces.push_back(face.get());
+        pResources->createSkyBox(skyBoxFaces);
+        pResources->createMesh(atlasModel.get(), atlasImage.get(), pResources->atlasCube);
+        pResources->loadImage(kenergyImage.get(), pResources->texImage3, pResources->texImageView3, pResources->texImageAlloc3, pResources->texSampler3);
+        pResources->texImage3Index = pResources->textureTable->registerTexture(*pResources->texImageView3, *pResources->texSampler3);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    if (error) {
+        // the model decodes still go through pResources, every task that was not
+        // collected yet has to be done before the exception unwinds past it
+        auto wait = [](auto& task) {
+            if (task.valid())
+                task.wait();
+        };
+        wait(cubeModel);
+        wait(vikingModel);
+        wait(atlasModel);
+        wait(statueImage);
+        wait(vikingImage);
+        wait(atlasImage);
+        wait(kenergyImage);
+        for (auto& face : faceImages)
+            wait(face);
+        std::rethrow_exception(error);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "assets loaded on " << threadPool.getThreadCount() << " threads in "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+    pResources->geometryHeap->printStats();
+}
+
 void Renderer::createInstance() {
+    PROFILE_ZONE("createInstance");
     if (debug && !checkValidationLayersSupport())
         throw std::runtime_error("validation layers requested, but not available!");
 
@@ -96,7 +193,8 @@ uint32_t Renderer::getQueueFamilyIndex() {
     uint32_t queueFamilyIndex{0};
     for (auto& queueFamily : queueFamilies)
         // remember to do a bitwise and operation
-        if (queueFamily.queueFlags & vk::QueueFlagBits::eGraphics && m_physicalDevice.getSurfaceSupportKHR(queueFamilyIndex, *pEngine->m_surface))
+        // without a surface any graphics queue will do
+        if (queueFamily.queueFlags & vk::QueueFlagBits::eGraphics && (headless || m_physicalDevice.getSurfaceSupportKHR(queueFamilyIndex, *pEngine->m_surface)))
             break;
         else
             queueFamilyIndex++;
@@ -105,12 +203,13 @@ uint32_t Renderer::getQueueFamilyIndex() {
 
 // functions to get all the required extensions for glfw to create a surface
 std::vector<const char*> Renderer::getRequiredExtensions() {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char*> extensions(glfwExtensions,
-        glfwExtensions + glfwExtensionCount);
+    std::vector<const char*> extensions{};
+    if (!headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (debug)
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -119,8 +218,17 @@ std::vector<const char*> Renderer::getRequiredExtensions() {
 }
 
 void Renderer::createDevice() {
+    PROFILE_ZONE("createDevice");
+    // the swapchain extension is the only thing a headless device does not need
+    if (headless)
+        std::erase_if(deviceExtensions, [](const char* extension) { return strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0; });
     m_physicalDevices = vk::raii::PhysicalDevices(m_instance);
     pickPhysicalDevice();
+    for (const auto& extension : m_physicalDevice.enumerateDeviceExtensionProperties())
+        if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+            memoryBudget = true;
+    if (memoryBudget)
+        deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
     auto queueFamilyIndex = getQueueFamilyIndex();
     float queuePriority = 1.0f;
 
@@ -132,7 +240,28 @@ void Renderer::createDevice() {
     vk::PhysicalDeviceFeatures2 deviceFeatures2{};
     vk::PhysicalDeviceVulkan13Features device13{};
     deviceFeatures2.features.samplerAnisotropy = true;
+    textureCompressionBC = m_physicalDevice.getFeatures().textureCompressionBC;
+    deviceFeatures2.features.textureCompressionBC = textureCompressionBC;
+    vk::PhysicalDeviceVulkan12Features device12{};
+    auto supportedFeatures = m_physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+    drawIndirectCount = supportedFeatures.get<vk::PhysicalDeviceVulkan12Features>().drawIndirectCount;
+    device12.drawIndirectCount = drawIndirectCount;
+    // everything the texture table relies on, the nonuniform indexing is
+    // only there for shaders that pick the texture per instance
+    const auto& supported10 = supportedFeatures.get<vk::PhysicalDeviceFeatures2>().features;
+    const auto& supported12 = supportedFeatures.get<vk::PhysicalDeviceVulkan12Features>();
+    descriptorIndexing = supported10.shaderSampledImageArrayDynamicIndexing && supported12.descriptorIndexing && supported12.runtimeDescriptorArray && supported12.descriptorBindingPartiallyBound && supported12.descriptorBindingVariableDescriptorCount && supported12.descriptorBindingSampledImageUpdateAfterBind;
+    // the fragment shader indexes the table with a push constant
+    deviceFeatures2.features.shaderSampledImageArrayDynamicIndexing = descriptorIndexing;
+    device12.descriptorIndexing = descriptorIndexing;
+    device12.runtimeDescriptorArray = descriptorIndexing;
+    device12.descriptorBindingPartiallyBound = descriptorIndexing;
+    device12.descriptorBindingVariableDescriptorCount = descriptorIndexing;
+    device12.descriptorBindingSampledImageUpdateAfterBind = descriptorIndexing;
+    device12.shaderSampledImageArrayNonUniformIndexing = descriptorIndexing && supported12.shaderSampledImageArrayNonUniformIndexing;
     device13.dynamicRendering = true;
+    device13.synchronization2 = true;
+    device13.pNext = &device12;
     deviceFeatures2.pNext = &device13;
     vk::DeviceCreateInfo createInfo{};
     createInfo.pNext = &deviceFeatures2;
@@ -188,17 +317,29 @@ void Renderer::listExtensionNames() {
 }
 
 void Renderer::mainLoop() {
+    if (benchmark) {
+        Benchmark{*this, warmupFrames, headlessFrames, benchmarkPath}.run();
+        return;
+    }
+    if (headless) {
+        runHeadless();
+        return;
+    }
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
         //changeColor(checkUserInput());
         drawFrame();
     }
     m_device.waitIdle();
+    pCapture->flush();
 }
 
 void Renderer::recordCommandbuffer(vk::raii::CommandBuffer& commandBuffer, uint32_t imageIndex) {
+    PROFILE_ZONE("recordCommandbuffer");
     vk::CommandBufferBeginInfo beginInfo{};
     commandBuffer.begin(beginInfo);
+    if (pGpuProfiler)
+        pGpuProfiler->beginFrame(commandBuffer, currentFrame);
 
     /* vk::RenderPassBeginInfo renderPassInfo{};
     renderPassInfo.renderPass = *pGraphics->renderPass;
@@ -210,77 +351,8 @@ void Renderer::recordCommandbuffer(vk::raii::CommandBuffer& commandBuffer, uint3
     vk::ClearValue clearColor{{0.0f, 0.0f, 0.0f, 1.0f}};
     renderPassInfo.clearValueCount = 1;
     renderPassInfo.pClearValues = &clearColor;*/
-    vk::ClearValue clearColor{{0.0f, 0.0f, 0.0f, 1.0f}};
-    std::vector<vk::Buffer> buffers{*pResources->viking.vertexBuffer, *pResources->instanceBuffer};
-    std::vector<vk::DeviceSize> offsets{0, 0};
-    
-    vk::RenderingInfo rInfo{};
-    vk::RenderingAttachmentInfo aInfo{};
-    vk::RenderingAttachmentInfo dInfo{};
-    vk::ClearValue depthClear{};
-    depthClear.depthStencil = vk::ClearDepthStencilValue{1.0, 0};
-    dInfo.clearValue = depthClear;
-    dInfo.imageLayout = vk::ImageLayout::eDepthAttachmentOptimal;
-    dInfo.loadOp = vk::AttachmentLoadOp::eClear;
-    dInfo.storeOp = vk::AttachmentStoreOp::eStore;
-    dInfo.imageView = *pResources->depthImageView;
-    
-    aInfo.clearValue = clearColor;
-    aInfo.imageLayout = vk::ImageLayout::eColorAttachmentOptimal;
-    aInfo.loadOp = vk::AttachmentLoadOp::eClear;
-    aInfo.storeOp = vk::AttachmentStoreOp::eStore;
-    aInfo.imageView = *pEngine->blitImageViews;
-    
-    rInfo.colorAttachmentCount = 1;
-    rInfo.pColorAttachments = &aInfo;
-    rInfo.pDepthAttachment = &dInfo;
-    rInfo.layerCount = 1;
-
-    rInfo.renderArea = vk::Rect2D{
-        {0, 0}, pEngine->swapChainExtent};
-    
-    transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal, commandBuffer, *pEngine->blitImage, vk::ImageAspectFlagBits::eColor);
-    //transitionImageLayout(vk::ImageLayout::eDepthAttachmentOptimal, vk::ImageLayout::eGeneral, commandBuffer, *pResources->depthImage, vk::ImageAspectFlagBits::eDepth);
-
-    vk::ImageSubresourceRange depthRange{};
-    depthRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
-    depthRange.baseArrayLayer = 0;
-    depthRange.baseMipLevel = 0;
-    depthRange.layerCount = 1;
-    depthRange.levelCount = 1;
-
-    static int index{};
-    if (glfwGetKey(window, GLFW_KEY_D))
-        index = 1;
-    else if (glfwGetKey(window, GLFW_KEY_F))
-        index = 0;
-    else if (glfwGetKey(window, GLFW_KEY_S))
-        index = 2;
-    //commandBuffer.clearDepthStencilImage(*pResources->depthImage, vk::ImageLayout::eGeneral, vk::ClearDepthStencilValue{1.0, 0}, depthRange);
-    //transitionImageLayout(vk::ImageLayout::eGeneral, vk::ImageLayout::eDepthAttachmentOptimal, commandBuffer, *pResources->depthImage, vk::ImageAspectFlagBits::eDepth);
-    commandBuffer.beginRendering(rInfo);
-    //commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
-    //commandBuffer.pushConstants<int>(*pGraphics->pipelineLayout, vk::ShaderStageFlagBits::eFragment, 0, index);
-    //commandBuffer.pushConstants<int>(*pGraphics->pipelineLayout, vk::ShaderStageFlagBits::eVertex, 4, 0);
-
-    vk::Viewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0;
-    viewport.width = static_cast<float>(pEngine->swapChainExtent.width);
-    viewport.height = static_cast<float>(pEngine->swapChainExtent.height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    commandBuffer.setViewport(0, viewport);
-
-    vk::Rect2D scissor{};
-    scissor.offset = vk::Offset2D{0, 0};
-    scissor.extent = pEngine->swapChainExtent;
-
     std::vector<MeshPushConstants> ubos{};
-    static auto startTime = std::chrono::high_resolution_clock::now();
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
-    static float pos{};
+    updateCamera();
     MeshPushConstants ubo{};
     ubo.model = glm::mat4(1.0f);
     ubo.view = glm::mat4(1.0f);
@@ -297,86 +369,104 @@ void Renderer::recordCommandbuffer(vk::raii::CommandBuffer& commandBuffer, uint3
     ubo2.proj = glm::perspective(glm::radians(45.0f), pEngine->swapChainExtent.width / (float)pEngine->swapChainExtent.height, 0.1f, 100.0f);
     ubo2.proj[1][1] *= -1;
     
-    static float xPos{};
-    if (glfwGetKey(window, GLFW_KEY_W))
-        pos += 0.002;
-    if (glfwGetKey(window, GLFW_KEY_S))
-        pos -= 0.002;
-    if (glfwGetKey(window, GLFW_KEY_A))
-        xPos += 0.002;
-    if (glfwGetKey(window, GLFW_KEY_D))
-        xPos -= 0.002;
-    
-    ubo.view = glm::lookAt(glm::vec3(0.2, 0.0f, 0.0f), glm::vec3(0, pos, xPos), glm::vec3(0.0f, 1.0f, 0.0f));
-    ubo2.view = glm::lookAt(glm::vec3(-2.0f, 2.0f, 1.5f), glm::vec3(xPos * 5, 0, pos * 5), glm::vec3(0.0f, 0.0f, 1.0f));
+    ubo.view = glm::lookAt(glm::vec3(0.2, 0.0f, 0.0f), glm::vec3(0, cameraPos, cameraXPos), glm::vec3(0.0f, 1.0f, 0.0f));
+    ubo2.view = glm::lookAt(glm::vec3(-2.0f, 2.0f, 1.5f), glm::vec3(cameraXPos * 5, 0, cameraPos * 5), glm::vec3(0.0f, 0.0f, 1.0f));
     ubos.emplace_back(ubo);
     ubos.emplace_back(ubo2);
-    vk::DeviceSize uboSize = sizeof(ubos[0]) * ubos.size();
-    memcpy(pResources->uboPtr2, &ubo, sizeof(ubo));
-    memcpy(pResources->uboPtr, ubos.data(), uboSize);
-
-    commandBuffer.setScissor(0, scissor);
-   
-    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *pGraphics->graphicsPipeline);
-    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pGraphics->pipelineLayout, 0, *pResources->descriptorSet[0], nullptr);
-    
-    commandBuffer.bindVertexBuffers(0, buffers, offsets);
-    //commandBuffer.bindIndexBuffer(*pResources->cube.indexBuffer, 0, vk::IndexType::eUint32);
-    commandBuffer.pushConstants<int>(*pGraphics->pipelineLayout, vk::ShaderStageFlagBits::eFragment, 0, index);
-    commandBuffer.pushConstants<int>(*pGraphics->pipelineLayout, vk::ShaderStageFlagBits::eVertex, 4, 1);
-    //commandBuffer.drawIndexed(pResources->cube.indicesCount, pResources->instances.size(), 0, 0, 0);
-    commandBuffer.draw(pResources->viking.verticesCount, 4, 0, 0);
+    auto& frame = pResources->frames[currentFrame];
 
-    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *pGraphics->skyGraphicsPipeline);
-    commandBuffer.bindVertexBuffers(0, *pResources->cube.vertexBuffer, {0});
-    //commandBuffer.bindIndexBuffer(*pResources->cube.indexBuffer, 0, vk::IndexType::eUint32);
-    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pGraphics->skyPipelineLayout, 0, *pResources->skyDescriptorSet[0], nullptr);
-    //commandBuffer.drawIndexed(pResources->cube.indicesCount, 1, 0, 0, 0);
-    commandBuffer.draw(pResources->cube.verticesCount, 1, 0, 0);
+    // the culling pass has to run before rendering starts, its planes come from
+    // the same matrices the viking mesh is drawn with
+    if (pCulling) {
+        GpuProfiler::Scope scope{pGpuProfiler.get(), commandBuffer, "gpu culling"};
+        pCulling->recordCulling(commandBuffer, currentFrame, ubo2.proj * ubo2.view * ubo2.model);
+    }
 
-    commandBuffer.endRendering();
+    vk::ClearValue clearColor{{0.0f, 0.0f, 0.0f, 1.0f}};
+    SceneDraw scene{};
+    scene.vertexBuffers = {pResources->geometryHeap->getVertexBuffer(), *pResources->instanceBuffer};
+    // interactive runs only show the first few instances, the benchmark draws
+    // every one of them so the instance count it reports is what gets drawn
+    scene.instanceCount = benchmark ? static_cast<uint32_t>(pResources->instances.size()) : 4;
+    scene.uniformOffset = pResources->frameAllocator->push(ubos.data(), ubos.size());
+    scene.skyUniformOffset = pResources->frameAllocator->push(&ubo, 1);
+    if (pCpuCulling) {
+        // the visible offsets are culled straight into the staging ring and
+        // copied into the frame's buffer ahead of rendering, the frame's fence
+        // was waited on so the buffer is free to overwrite
+        auto planes = CpuCulling::getFrustumPlanes(ubo2.proj * ubo2.view * ubo2.model);
+        StagingRing::Allocation staging{};
+        if (!pResources->stagingRing->allocate(sizeof(glm::vec3) * pResources->instances.size(), 16, staging))
+            throw std::runtime_error("the visible instances don't fit into the staging ring");
+        scene.instanceCount = static_cast<uint32_t>(pCpuCulling->cull(planes, static_cast<glm::vec3*>(staging.ptr)));
+        if (scene.instanceCount > 0) {
+            vk::BufferCopy copyRegion{};
+            copyRegion.size = sizeof(glm::vec3) * scene.instanceCount;
+            copyRegion.srcOffset = staging.offset;
+            pResources->stagingRing->flush(copyRegion.srcOffset, copyRegion.size);
+            commandBuffer.copyBuffer(staging.buffer, *frame.visibleInstanceBuffer, copyRegion);
+
+            vk::MemoryBarrier barrier{};
+            barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+            barrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead;
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexInput, {}, barrier, nullptr, nullptr);
+        }
+        scene.vertexBuffers[1] = *frame.visibleInstanceBuffer;
+    }
+    
+    // the keys pick which registered texture the scene is drawn with
+    const std::array<uint32_t, 3> textureSlots{pResources->atlasCube.textureIndex, pResources->viking.textureIndex, pResources->texImage3Index};
+    static int index{1};
+    if (isKeyPressed(GLFW_KEY_D))
+        index = 1;
+    else if (isKeyPressed(GLFW_KEY_F))
+        index = 0;
+    else if (isKeyPressed(GLFW_KEY_S))
+        index = 2;
+    scene.textureIndex = static_cast<int>(textureSlots[index]);
 
-    //transitionImageLayout(vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR, commandBuffer, pEngine->swapChainImages[imageIndex]);
+    // headless runs have no swapchain, the frame stays in the blit image
+    pFrameGraph->reset();
+    auto color = pFrameGraph->importImage(*pEngine->blitImage, *pEngine->blitImageViews, pEngine->swapChainExtent, headless);
+    auto depth = pFrameGraph->createImage("depth", {vk::Format::eD32Sfloat, pEngine->swapChainExtent, vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::ImageAspectFlagBits::eDepth});
+    vk::ClearValue depthClear{};
+    depthClear.depthStencil = vk::ClearDepthStencilValue{1.0, 0};
 
-    transitionImageLayout(vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::eTransferSrcOptimal, commandBuffer, *pEngine->blitImage, vk::ImageAspectFlagBits::eColor);
+    auto& scenePass = pFrameGraph->addRenderPass("scene").writeColor(color, clearColor).writeDepth(depth, depthClear);
+    if (pRecorder) {
+        scenePass.setRenderingFlags(vk::RenderingFlagBits::eContentsSecondaryCommandBuffers);
+        scenePass.setExecute([this, &scene](vk::raii::CommandBuffer& commandBuffer) {
+            pRecorder->record(commandBuffer, currentFrame, [this, &scene](vk::raii::CommandBuffer& secondary, uint32_t chunk, uint32_t chunkCount) {
+                recordSceneChunk(secondary, scene, chunk, chunkCount);
+            });
+        });
+    } else {
+        scenePass.setExecute([this, &scene](vk::raii::CommandBuffer& commandBuffer) {
+            recordSceneChunk(commandBuffer, scene, 0, 1);
+        });
+    }
+    if (captureRequested) {
+        // the blit converts the frame to rgba so the encoder takes the bytes as they
+        // are, the image only lives after the scene pass so it can alias the depth buffer
+        auto captureImage = pFrameGraph->createImage("capture", {ScreenCapture::getCaptureFormat(pEngine->swapChainImagesFormat), pEngine->swapChainExtent, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc, vk::ImageAspectFlagBits::eColor});
+        pFrameGraph->addPass("capture convert").read(color, StateTracker::Usage::TransferSrc).write(captureImage, StateTracker::Usage::TransferDst).setExecute([this, captureImage](vk::raii::CommandBuffer& commandBuffer) {
+            recordBlit(commandBuffer, pFrameGraph->getImage(captureImage));
+        });
+        pFrameGraph->addPass("capture").read(captureImage, StateTracker::Usage::TransferSrc).setSideEffect().setExecute([this, captureImage](vk::raii::CommandBuffer& commandBuffer) {
+            pCapture->recordCapture(commandBuffer, currentFrame, pFrameGraph->getImage(captureImage));
+        });
+    }
+    if (!headless)
+        addSwapchainPasses(color, imageIndex);
     /* BIG NOTE
     // barriers syncs things between all the commands which happen before the barrier
     // was inserted and all the commands which come after the barrier, what it means is that
     // for all commands named C after barrier B was inserted needs to wait in their specified
     // dst stages until all commands before the barrier named A have finised their operations
     // specified in their src stage flags*/
-    transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, commandBuffer, pEngine->swapChainImages[imageIndex], vk::ImageAspectFlagBits::eColor);
-   
-    vk::ImageBlit region{};
-    vk::ImageSubresourceLayers layers{};
-    region.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-    region.srcSubresource.mipLevel = 0;
-    region.srcSubresource.baseArrayLayer = 0;
-    region.srcSubresource.layerCount = 1;
-    // region.src/dstOffsets just define the range of the images
-    // the blit command will copy ie from 0 to the height/width of
-    // the image
-    region.srcOffsets[0].x = 0;
-    region.srcOffsets[0].y = 0;
-    region.srcOffsets[0].z = 0;
-    region.srcOffsets[1].x = pEngine->swapChainExtent.width;
-    region.srcOffsets[1].y = pEngine->swapChainExtent.height;
-    region.srcOffsets[1].z = 1;
-    region.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-    region.dstSubresource.mipLevel = 0;
-    region.dstSubresource.baseArrayLayer = 0;
-    region.dstSubresource.layerCount = 1;
-    region.dstOffsets[0].x = 0;
-    region.dstOffsets[0].y = 0;
-    region.dstOffsets[0].z = 0;
-    region.dstOffsets[1].x = pEngine->swapChainExtent.width;
-    region.dstOffsets[1].y = pEngine->swapChainExtent.height;
-    region.dstOffsets[1].z = 1;
-
-    
-
-    commandBuffer.blitImage(*pEngine->blitImage, vk::ImageLayout::eTransferSrcOptimal, pEngine->swapChainImages[imageIndex], vk::ImageLayout::eTransferDstOptimal, region, vk::Filter::eLinear);
-    transitionImageLayout(vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::ePresentSrcKHR, commandBuffer, pEngine->swapChainImages[imageIndex], vk::ImageAspectFlagBits::eColor);
+    pFrameGraph->execute(commandBuffer);
+    if (pGpuProfiler)
+        pGpuProfiler->endFrame(commandBuffer);
     try {
         commandBuffer.end();
     } catch (vk::SystemError err) {
@@ -384,17 +474,73 @@ void Renderer::recordCommandbuffer(vk::raii::CommandBuffer& commandBuffer, uint3
     }
 }
 
-void Renderer::recordComputeCB(vk::raii::CommandBuffer& commandBuffer, uint32_t imageIndex) {
-    vk::CommandBufferBeginInfo beginInfo{};
-    commandBuffer.begin(beginInfo);
-    transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, commandBuffer, *pEngine->blitImage, vk::ImageAspectFlagBits::eColor);
-    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *pGraphics->computePipeline);
-    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pGraphics->computePipelineLayout, 0, *pResources->computeDescriptorSet, nullptr);
-    commandBuffer.pushConstants<glm::ivec2>(*pGraphics->computePipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, glm::ivec2{pEngine->swapChainExtent.width, pEngine->swapChainExtent.height});
-    commandBuffer.dispatch(128, 128, 1);
-    transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, commandBuffer, pEngine->swapChainImages[imageIndex], vk::ImageAspectFlagBits::eColor);
-    transitionImageLayout(vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal, commandBuffer, *pEngine->blitImage, vk::ImageAspectFlagBits::eColor);
+void Renderer::recordSceneChunk(vk::raii::CommandBuffer& commandBuffer, const SceneDraw& scene, uint32_t chunk, uint32_t chunkCount) {
+    PROFILE_ZONE("recordSceneChunk");
+    // secondary command buffers inherit no dynamic state or bindings, every chunk sets up its own
+    auto& frame = pResources->frames[currentFrame];
+    vk::Viewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0;
+    viewport.width = static_cast<float>(pEngine->swapChainExtent.width);
+    viewport.height = static_cast<float>(pEngine->swapChainExtent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    commandBuffer.setViewport(0, viewport);
+
+    vk::Rect2D scissor{};
+    scissor.offset = vk::Offset2D{0, 0};
+    scissor.extent = pEngine->swapChainExtent;
+
+    commandBuffer.setScissor(0, scissor);
+   
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *pGraphics->graphicsPipeline);
+    std::array<vk::DescriptorSet, 2> sets{*frame.descriptorSet, *pResources->textureTable->getDescriptorSet()};
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pGraphics->pipelineLayout, 0, sets, scene.uniformOffset);
     
+    std::array<vk::DeviceSize, 2> offsets{0, 0};
+    commandBuffer.bindVertexBuffers(0, scene.vertexBuffers, offsets);
+    // every mesh lives in the geometry heap, it is bound once and the draws pick their range
+    commandBuffer.bindIndexBuffer(pResources->geometryHeap->getIndexBuffer(), 0, pResources->viking.indexType);
+    commandBuffer.pushConstants<int>(*pGraphics->pipelineLayout, vk::ShaderStageFlagBits::eFragment, 0, scene.textureIndex);
+    commandBuffer.pushConstants<int>(*pGraphics->pipelineLayout, vk::ShaderStageFlagBits::eVertex, 4, 1);
+    if (pResources->viking.compact) {
+        std::array<glm::vec4, 2> dequantize{pResources->viking.positionScale, pResources->viking.positionOffset};
+        commandBuffer.pushConstants<glm::vec4>(*pGraphics->pipelineLayout, vk::ShaderStageFlagBits::eVertex, 16, dequantize);
+    }
+    if (pCulling) {
+        // the indirect draw covers every instance, it can't be split
+        if (chunk == 0)
+            pCulling->recordDraw(commandBuffer, currentFrame);
+    } else {
+        uint32_t firstInstance{static_cast<uint32_t>(uint64_t{scene.instanceCount} * chunk / chunkCount)};
+        uint32_t lastInstance{static_cast<uint32_t>(uint64_t{scene.instanceCount} * (chunk + 1) / chunkCount)};
+        if (lastInstance > firstInstance)
+            commandBuffer.drawIndexed(pResources->viking.indicesCount, lastInstance - firstInstance, pResources->viking.firstIndex, pResources->viking.vertexOffset, firstInstance);
+    }
+
+    // chunks are executed in order so the skybox still comes after every instance
+    if (chunk + 1 != chunkCount)
+        return;
+    GpuProfiler::Scope scope{pGpuProfiler.get(), commandBuffer, "skybox"};
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *pGraphics->skyGraphicsPipeline);
+    // the index type is part of the binding, only a mesh with a different one rebinds
+    if (pResources->cube.indexType != pResources->viking.indexType)
+        commandBuffer.bindIndexBuffer(pResources->geometryHeap->getIndexBuffer(), 0, pResources->cube.indexType);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pGraphics->skyPipelineLayout, 0, *frame.skyDescriptorSet, scene.skyUniformOffset);
+    commandBuffer.drawIndexed(pResources->cube.indicesCount, 1, pResources->cube.firstIndex, pResources->cube.vertexOffset, 0);
+}
+
+void Renderer::addSwapchainPasses(FrameGraph::ImageHandle source, uint32_t imageIndex) {
+    // the acquire semaphore is waited on at the color attachment output stage,
+    // the transition has to chain onto that wait
+    stateTracker.assume(pEngine->swapChainImages[imageIndex], {vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2::eNone});
+    auto swapchainImage = pFrameGraph->importImage(pEngine->swapChainImages[imageIndex], *pEngine->swapChainImageViews[imageIndex], pEngine->swapChainExtent, true, StateTracker::Usage::Present);
+    pFrameGraph->addPass("swapchain blit").read(source, StateTracker::Usage::TransferSrc).write(swapchainImage, StateTracker::Usage::TransferDst).setExecute([this, imageIndex](vk::raii::CommandBuffer& commandBuffer) {
+        recordBlit(commandBuffer, pEngine->swapChainImages[imageIndex]);
+    });
+}
+
+void Renderer::recordBlit(vk::raii::CommandBuffer& commandBuffer, vk::Image destination) {
     vk::ImageBlit region{};
     vk::ImageSubresourceLayers layers{};
     region.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
@@ -421,8 +567,22 @@ void Renderer::recordComputeCB(vk::raii::CommandBuffer& commandBuffer, uint32_t
     region.dstOffsets[1].y = pEngine->swapChainExtent.height;
     region.dstOffsets[1].z = 1;
 
-    commandBuffer.blitImage(*pEngine->blitImage, vk::ImageLayout::eTransferSrcOptimal, pEngine->swapChainImages[imageIndex], vk::ImageLayout::eTransferDstOptimal, region, vk::Filter::eLinear);
-    transitionImageLayout(vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::ePresentSrcKHR, commandBuffer, pEngine->swapChainImages[imageIndex], vk::ImageAspectFlagBits::eColor);
+    commandBuffer.blitImage(*pEngine->blitImage, vk::ImageLayout::eTransferSrcOptimal, destination, vk::ImageLayout::eTransferDstOptimal, region, vk::Filter::eLinear);
+}
+
+void Renderer::recordComputeCB(vk::raii::CommandBuffer& commandBuffer, uint32_t imageIndex) {
+    vk::CommandBufferBeginInfo beginInfo{};
+    commandBuffer.begin(beginInfo);
+    pFrameGraph->reset();
+    auto color = pFrameGraph->importImage(*pEngine->blitImage, *pEngine->blitImageViews, pEngine->swapChainExtent, false);
+    pFrameGraph->addPass("compute").write(color, StateTracker::Usage::ComputeShaderWrite).setExecute([this](vk::raii::CommandBuffer& commandBuffer) {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *pGraphics->computePipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pGraphics->computePipelineLayout, 0, *pResources->computeDescriptorSet, nullptr);
+        commandBuffer.pushConstants<glm::ivec2>(*pGraphics->computePipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, glm::ivec2{pEngine->swapChainExtent.width, pEngine->swapChainExtent.height});
+        commandBuffer.dispatch(128, 128, 1);
+    });
+    addSwapchainPasses(color, imageIndex);
+    pFrameGraph->execute(commandBuffer);
     try {
         commandBuffer.end();
     } catch (vk::SystemError err) {
@@ -430,6 +590,26 @@ void Renderer::recordComputeCB(vk::raii::CommandBuffer& commandBuffer, uint32_t
     }
 }
 
+void Renderer::updateCamera() {
+    frameNumber++;
+    if (benchmark) {
+        // a slow circle around the starting target, one loop every 600 frames
+        constexpr uint64_t pathFrames{600};
+        float angle{glm::two_pi<float>() * static_cast<float>(frameNumber % pathFrames) / pathFrames};
+        cameraPos = 0.5f * std::sin(angle);
+        cameraXPos = 0.5f * std::cos(angle);
+        return;
+    }
+    if (isKeyPressed(GLFW_KEY_W))
+        cameraPos += 0.002f;
+    if (isKeyPressed(GLFW_KEY_S))
+        cameraPos -= 0.002f;
+    if (isKeyPressed(GLFW_KEY_A))
+        cameraXPos += 0.002f;
+    if (isKeyPressed(GLFW_KEY_D))
+        cameraXPos -= 0.002f;
+}
+
 void Renderer::createRandomNumberGenerator() {
     std::random_device rd{};
     std::seed_seq seq{
@@ -503,7 +683,16 @@ void Renderer::changeColor(Colors color) {
 }
 
 void Renderer::drawFrame() {
-    m_device.waitForFences(*pResources->inFlightFences, VK_TRUE, UINT64_MAX);
+    PROFILE_ZONE("drawFrame");
+    auto& frame = pResources->frames[currentFrame];
+    {
+        PROFILE_ZONE("waitForFences");
+        m_device.waitForFences(*frame.inFlightFence, VK_TRUE, UINT64_MAX);
+    }
+    pCapture->poll();
+    pResources->collectUploads();
+    pResources->frameAllocator->beginFrame(currentFrame);
+    memoryTelemetry.nextFrame();
 
     vk::Result result;
     uint32_t imageIndex{};
@@ -513,8 +702,9 @@ void Renderer::drawFrame() {
     //  so the try catch blocks are necessary to successfully recreate
     //  the swapchain
     try {
+        PROFILE_ZONE("acquireNextImage");
         std::tie(result, imageIndex) = pEngine->m_swapChain.acquireNextImage(UINT64_MAX,
-            *pResources->imageAvailableSemaphores);
+            *frame.imageAvailableSemaphore);
     } catch (vk::Error& err) {
         std::cout << err.what();
         recreateSwapchain();
@@ -525,44 +715,108 @@ void Renderer::drawFrame() {
         return;
     }
 
-    m_device.resetFences(*pResources->inFlightFences);
+    m_device.resetFences(*frame.inFlightFence);
     
-    pResources->commandBuffer[0].reset();
-    recordCommandbuffer(pResources->commandBuffer[0], imageIndex);
-    //recordComputeCB(pResources->commandBuffer[0], imageIndex);
+    // holding P captures every frame until it is released
+    captureRequested = isKeyPressed(GLFW_KEY_P);
+    frame.commandBuffer.reset();
+    recordCommandbuffer(frame.commandBuffer, imageIndex);
+    //recordComputeCB(frame.commandBuffer, imageIndex);
     vk::SubmitInfo submitInfo{};
     submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &(*pResources->imageAvailableSemaphores);
+    submitInfo.pWaitSemaphores = &(*frame.imageAvailableSemaphore);
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &(*pResources->commandBuffer[0]);
+    submitInfo.pCommandBuffers = &(*frame.commandBuffer);
     vk::PipelineStageFlags waitStages{vk::PipelineStageFlagBits::eColorAttachmentOutput};
     submitInfo.pWaitDstStageMask = &waitStages;
     submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &(*pResources->finishedRenderingSemaphores);
-    m_queue.submit(submitInfo, *pResources->inFlightFences);
-
-    if (glfwGetKey(window, GLFW_KEY_P))
-        screenCapture();
+    submitInfo.pSignalSemaphores = &(*frame.finishedRenderingSemaphore);
+    // uploads staged while recording go out ahead of the frame so its fence
+    // also covers their ring space
+    pResources->submitUploads();
+    pResources->stagingRing->closeFrame(currentFrame);
+    pResources->frameAllocator->endFrame();
+    {
+        PROFILE_ZONE("queueSubmit");
+        m_queue.submit(submitInfo, *frame.inFlightFence);
+    }
+    frame.submitCount++;
 
     vk::PresentInfoKHR presentInfo{};
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &(*pResources->finishedRenderingSemaphores);
+    presentInfo.pWaitSemaphores = &(*frame.finishedRenderingSemaphore);
     presentInfo.pImageIndices = &imageIndex;
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &(*pEngine->m_swapChain);
     presentInfo.pResults = nullptr;
 
+    currentFrame = (currentFrame + 1) % framesInFlight;
+
     try {
+        PROFILE_ZONE("presentKHR");
         result = m_queue.presentKHR(presentInfo);
     } catch (vk::Error& err) {
         std::cerr << err.what();
         recreateSwapchain();
+        return;
     }
     if (result == vk::Result::eErrorOutOfDateKHR || result == vk::Result::eSuboptimalKHR) {
         recreateSwapchain();
     }
 }
 
+void Renderer::drawHeadlessFrame() {
+    PROFILE_ZONE("drawHeadlessFrame");
+    auto& frame = pResources->frames[currentFrame];
+    {
+        PROFILE_ZONE("waitForFences");
+        m_device.waitForFences(*frame.inFlightFence, VK_TRUE, UINT64_MAX);
+    }
+    m_device.resetFences(*frame.inFlightFence);
+    pCapture->poll();
+    pResources->collectUploads();
+    pResources->frameAllocator->beginFrame(currentFrame);
+    memoryTelemetry.nextFrame();
+
+    // there is no image to acquire or present so nothing to wait on
+    frame.commandBuffer.reset();
+    recordCommandbuffer(frame.commandBuffer, 0);
+    vk::SubmitInfo submitInfo{};
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &(*frame.commandBuffer);
+    // uploads staged while recording go out ahead of the frame so its fence
+    // also covers their ring space
+    pResources->submitUploads();
+    pResources->stagingRing->closeFrame(currentFrame);
+    pResources->frameAllocator->endFrame();
+    {
+        PROFILE_ZONE("queueSubmit");
+        m_queue.submit(submitInfo, *frame.inFlightFence);
+    }
+    frame.submitCount++;
+
+    currentFrame = (currentFrame + 1) % framesInFlight;
+}
+
+void Renderer::runHeadless() {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t frame{}; frame < headlessFrames; frame++)
+        drawHeadlessFrame();
+    m_device.waitIdle();
+    pCapture->flush();
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    double seconds = std::chrono::duration<double, std::chrono::seconds::period>(endTime - startTime).count();
+    std::cout << "rendered " << headlessFrames << " headless frames in " << seconds << "s ("
+              << headlessFrames / seconds << " fps)\n";
+}
+
+bool Renderer::isKeyPressed(int key) {
+    if (headless)
+        return false;
+    return glfwGetKey(window, key) == GLFW_PRESS;
+}
+
 // I really dont know how it works but it works
 void Renderer::setupDebugCallback() {
     if (!debug)
@@ -596,6 +850,7 @@ VKAPI_ATTR VkBool32 VKAPI_CALL Renderer::debugCallback(VkDebugUtilsMessageSeveri
 }
 
 void Renderer::recreateSwapchain() {
+    PROFILE_ZONE("recreateSwapchain");
     int width = 0, height = 0;
     glfwGetFramebufferSize(window, &width, &height);
     while (width == 0 || height == 0) {
@@ -605,16 +860,18 @@ void Renderer::recreateSwapchain() {
     try {
         m_device.waitIdle();
         cleanupSwapchain();
-        pResources->imageAvailableSemaphores.clear();
+        // a failed acquire can leave any of the frames semaphores signaled
         vk::SemaphoreCreateInfo semaphoreInfo{};
-        pResources->imageAvailableSemaphores = m_device.createSemaphore(semaphoreInfo);
+        for (auto& frame : pResources->frames) {
+            frame.imageAvailableSemaphore.clear();
+            frame.imageAvailableSemaphore = m_device.createSemaphore(semaphoreInfo);
+        }
         pEngine->createSwapchain();
         pEngine->createSwapchainImages();
         pEngine->createImageViews();
         //pResources->createframebuffers();
         pEngine->createBlitImage();
         pEngine->createBlitImageView();
-        pResources->createDepthBuffer();
         //pResources->computeDescriptorSet.clear();
         //pResources->allocateComputeDescSet();
     } catch (vk::Error& err) {
@@ -622,105 +879,6 @@ void Renderer::recreateSwapchain() {
     }
 }
 
-void Renderer::transitionImageLayout(vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::raii::CommandBuffer& commandBuffer, const vk::Image& image, vk::ImageAspectFlags aspect, bool isCubeMap) {
-    vk::ImageMemoryBarrier memoryBarrier{};
-    memoryBarrier.oldLayout = oldLayout;
-    memoryBarrier.newLayout = newLayout;
-    memoryBarrier.image = image;
-    memoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    memoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    memoryBarrier.subresourceRange.aspectMask = aspect;
-    memoryBarrier.subresourceRange.baseMipLevel = 0;
-    memoryBarrier.subresourceRange.levelCount = 1;
-    memoryBarrier.subresourceRange.baseArrayLayer = 0;
-    if (isCubeMap)
-        memoryBarrier.subresourceRange.layerCount = 6;
-    else {
-        memoryBarrier.subresourceRange.layerCount = 1;
-    }
-
-    vk::PipelineStageFlags sourceStage;
-    vk::PipelineStageFlags destinationStage;
-
-
-    if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eTransferDstOptimal) {
-        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eNoneKHR;
-        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-
-        sourceStage = vk::PipelineStageFlagBits::eTransfer;
-        destinationStage = vk::PipelineStageFlagBits::eTransfer;
-    } else if (oldLayout == vk::ImageLayout::eTransferDstOptimal && newLayout == vk::ImageLayout::ePresentSrcKHR) {
-        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eNoneKHR;
-
-        sourceStage = vk::PipelineStageFlagBits::eTransfer;
-        destinationStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-    } else if (oldLayout == vk::ImageLayout::eColorAttachmentOptimal && newLayout == vk::ImageLayout::eTransferSrcOptimal) {
-        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
-        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
-
-        sourceStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-        destinationStage = vk::PipelineStageFlagBits::eTransfer;
-
-    } else if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eColorAttachmentOptimal) {
-        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eNone;
-        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
-
-        sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
-        destinationStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-
-    } else if (oldLayout == vk::ImageLayout::eColorAttachmentOptimal && newLayout == vk::ImageLayout::ePresentSrcKHR) {
-        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
-        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eNone;
-
-        sourceStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-        destinationStage = vk::PipelineStageFlagBits::eBottomOfPipe;
-
-    } else if (oldLayout == vk::ImageLayout::eTransferDstOptimal && newLayout == vk::ImageLayout::eShaderReadOnlyOptimal) {
-        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-
-        sourceStage = vk::PipelineStageFlagBits::eTransfer;
-        destinationStage = vk::PipelineStageFlagBits::eFragmentShader;
-
-    } else if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eDepthAttachmentOptimal) {
-        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eNone;
-        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-
-        sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
-        destinationStage = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
-    } else if (oldLayout == vk::ImageLayout::eDepthAttachmentOptimal && newLayout == vk::ImageLayout::eGeneral) {
-        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eNone;
-        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-
-        sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
-        destinationStage = vk::PipelineStageFlagBits::eAllCommands;
-    } else if (oldLayout == vk::ImageLayout::eGeneral && newLayout == vk::ImageLayout::eDepthAttachmentOptimal) {
-        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-
-        sourceStage = vk::PipelineStageFlagBits::eTransfer;
-        destinationStage = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
-    } else if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eGeneral) {
-        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eNone;
-        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
-
-        sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
-        destinationStage = vk::PipelineStageFlagBits::eComputeShader;
-    } else if (oldLayout == vk::ImageLayout::eGeneral && newLayout == vk::ImageLayout::eTransferSrcOptimal) {
-        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
-        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
-
-        sourceStage = vk::PipelineStageFlagBits::eComputeShader;
-        destinationStage = vk::PipelineStageFlagBits::eTransfer;
-    }
-
-    else {
-        throw std::invalid_argument("unsupported layout transition!");
-    }
-    commandBuffer.pipelineBarrier(sourceStage, destinationStage, vk::DependencyFlagBits{}, nullptr, nullptr, memoryBarrier);
-}
-
 void Renderer::cleanupSwapchain() {
     for (auto& framebuffer : pResources->frambebuffers)
         framebuffer.~Framebuffer();
@@ -728,32 +886,30 @@ void Renderer::cleanupSwapchain() {
         imageViews.~ImageView();
     pEngine->m_swapChain.~SwapchainKHR();
     pEngine->blitImageViews.~ImageView();
-    pEngine->blitImage.clear();
-    pEngine->blitImageMemory.~DeviceMemory();
-    pResources->depthImage.clear();
-    pResources->depthImageView.clear();
-    vmaFreeMemory(allocator, pResources->depthAlloc);
+    pEngine->destroyBlitImage();
+    // the graph recreates the transients at the new size on the next frame
+    pFrameGraph->releaseTransients();
 }
 
 Renderer::Colors Renderer::checkUserInput() {
-    std::array<int, 6> keys{};
-    keys[0] = glfwGetKey(window, GLFW_KEY_1);
-    keys[1] = glfwGetKey(window, GLFW_KEY_2);
-    keys[2] = glfwGetKey(window, GLFW_KEY_3);
-    keys[3] = glfwGetKey(window, GLFW_KEY_4);
-    keys[4] = glfwGetKey(window, GLFW_KEY_5);
-    keys[5] = glfwGetKey(window, GLFW_KEY_6);
-    if (keys[0] == GLFW_PRESS)
+    std::array<bool, 6> keys{};
+    keys[0] = isKeyPressed(GLFW_KEY_1);
+    keys[1] = isKeyPressed(GLFW_KEY_2);
+    keys[2] = isKeyPressed(GLFW_KEY_3);
+    keys[3] = isKeyPressed(GLFW_KEY_4);
+    keys[4] = isKeyPressed(GLFW_KEY_5);
+    keys[5] = isKeyPressed(GLFW_KEY_6);
+    if (keys[0])
         return Red;
-    if (keys[1] == GLFW_PRESS)
+    if (keys[1])
         return Green;
-    if (keys[2] == GLFW_PRESS)
+    if (keys[2])
         return Blue;
-    if (keys[3] == GLFW_PRESS)
+    if (keys[3])
         return RGB;
-    if (keys[4] == GLFW_PRESS)
+    if (keys[4])
         return RG;
-    if (keys[5] == GLFW_PRESS)
+    if (keys[5])
         return GB;
     return NoColor;
 }
@@ -775,67 +931,23 @@ int Renderer::getUserInput() {
     }
 }
 
-void Renderer::screenCapture() {
-    vk::raii::Buffer stagingBuffer{nullptr};
-    VmaAllocation allocation{nullptr};
-    vk::DeviceSize size = pEngine->swapChainExtent.width * pEngine->swapChainExtent.height * 4;
-    stagingBuffer = pResources->createBuffer(vk::BufferUsageFlagBits::eTransferDst, size, VmaAllocationCreateFlagBits::VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT, 0, allocation);
-    auto src = pResources->mapPersistentMemory(allocator, allocation, size);
-    if (!src)
-        std::cout << "mapping buffer for image failed\n";
-
-    vk::BufferImageCopy bufferCopy{};
-    bufferCopy.bufferRowLength = 0;
-    bufferCopy.bufferOffset = 0;
-    bufferCopy.bufferImageHeight = 0;
-    bufferCopy.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-    bufferCopy.imageSubresource.mipLevel = 0;
-    bufferCopy.imageSubresource.baseArrayLayer = 0;
-    bufferCopy.imageSubresource.layerCount = 1;
-    bufferCopy.imageOffset = vk::Offset3D{0, 0, 0};
-    bufferCopy.imageExtent = vk::Extent3D{
-        static_cast<uint32_t>(pEngine->swapChainExtent.width),
-        static_cast<uint32_t>(pEngine->swapChainExtent.height),
-        1};
-
-    vk::MemoryBarrier barrier{};
-    barrier.srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
-    barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
-    vk::MemoryBarrier barrier2{};
-    barrier2.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-    barrier2.dstAccessMask = vk::AccessFlagBits::eHostRead;
-    auto cb{pResources->createSingleTimeCB()};
-    vk::CommandBufferBeginInfo beginInfo{};
-    beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-    cb.begin(beginInfo);
-    cb.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eTransfer, {}, barrier, nullptr, nullptr);
-    cb.copyImageToBuffer(*pEngine->blitImage, vk::ImageLayout::eTransferSrcOptimal, *stagingBuffer, bufferCopy);
-    cb.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, barrier2, nullptr, nullptr);
-    cb.end();
-
-    vk::SubmitInfo submitInfo{};
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &*cb;
-    m_queue.submit(submitInfo, *pResources->screenCaptureFence);
-    m_device.waitForFences(*pResources->screenCaptureFence, VK_TRUE, UINT64_MAX);
-    vmaInvalidateAllocation(allocator, allocation, 0, size);
-
-    std::vector<stbi_uc*> pixels(size);
-    std::memcpy(pixels.data(), src, size);
-    stbi_write_png("screenshot.png", pEngine->swapChainExtent.width, pEngine->swapChainExtent.height, STBI_rgb_alpha, pixels.data(), pEngine->swapChainExtent.width * 4);
-
-    m_device.resetFences(*pResources->screenCaptureFence);
-
-    stagingBuffer.clear();
-    vmaUnmapMemory(allocator, allocation);
-    vmaFreeMemory(allocator, allocation);
-}
-
 void Renderer::pickPhysicalDevice() {
     if (m_physicalDevices.size() == 1) {
         m_physicalDevice = m_physicalDevices[0];
         return;
     }
+    // nobody is around to answer the prompt on a render node or a ci machine
+    // so take the first device that has everything we need, software ones included
+    if (headless) {
+        for (const auto& device : m_physicalDevices) {
+            if (checkDeviceExtensionSuppport(device)) {
+                m_physicalDevice = device;
+                std::cout << m_physicalDevice.getProperties().deviceName << '\n';
+                return;
+            }
+        }
+        throw std::runtime_error("no device supports the required extensions!");
+    }
     vk::PhysicalDeviceType deviceType{};
     auto getUserDevice{getUserInput()};
 
@@ -867,13 +979,17 @@ bool Renderer::checkDeviceExtensionSuppport(vk::raii::PhysicalDevice device) {
 }
 
 void Renderer::createAllocator() {
+    PROFILE_ZONE("createAllocator");
     VmaAllocatorCreateInfo info{};
     info.vulkanApiVersion = VK_API_VERSION_1_3;
     info.instance = *m_instance;
     info.physicalDevice = *m_physicalDevice;
     info.device = *m_device;
+    if (memoryBudget)
+        info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
    
    vmaCreateAllocator(&info, &allocator);
+   memoryTelemetry.init(allocator, memoryBudget, memoryStatsPath);
 }
 
 void Renderer::framebufferResizeCallback(GLFWwindow* window, int width, int height) {
@@ -895,25 +1011,128 @@ Renderer::~Renderer() {
     m_physicalDevices.clear();
     // TODO move all the resources to resource destructor
     //vmaFreeMemory(allocator, pResources->texImageAlloc2);
-    vmaFreeMemory(allocator, pResources->texImageAlloc3);
-    vmaFreeMemory(allocator, pResources->depthAlloc);
+    memoryTelemetry.free(pResources->texImageAlloc3);
+    pCapture.reset();
+    pCulling.reset();
+    pRecorder.reset();
+    if (pFrameGraph) {
+        pFrameGraph->printStats();
+        pFrameGraph.reset();
+    }
+    if (!cpuTracePath.empty()) {
+        CpuProfiler::get().stop();
+        CpuProfiler::get().writeChromeTrace(cpuTracePath);
+    }
+    if (pGpuProfiler) {
+        pGpuProfiler->printStats();
+        if (!gpuProfilePath.empty())
+            pGpuProfiler->dump();
+        pGpuProfiler.reset();
+    }
+    if (pPipelineCache) {
+        pPipelineCache->save();
+        pPipelineCache->printStats();
+        pPipelineCache.reset();
+    }
     vmaDestroyAllocator(allocator);
     m_device.clear();
     pEngine->m_surface.clear();
     if (debug)
         DestroyDebugUtilsMessengerEXT(*m_instance, callback, nullptr);
     m_instance.clear();
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (!headless) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
 }
 
 Renderer::Renderer(const std::vector<std::string>& args) {
     this->args = args;
-    if (args.size() < 1)
-        ;
-    else
-        modelName = args[0];
+    const std::string framesOption{"--frames-in-flight="};
+    const std::string headlessOption{"--headless"};
+    const std::string headlessFramesOption{"--headless-frames="};
+    const std::string compactVerticesOption{"--compact-vertices"};
+    const std::string gpuCullingOption{"--gpu-culling"};
+    const std::string instancesOption{"--instances="};
+    const std::string cpuCullingOption{"--cpu-culling"};
+    const std::string cullBenchmarkOption{"--cull-benchmark"};
+    const std::string recordThreadsOption{"--record-threads="};
+    const std::string gpuProfileOption{"--gpu-profile"};
+    const std::string cpuTraceOption{"--cpu-trace="};
+    const std::string benchmarkOption{"--benchmark"};
+    const std::string warmupFramesOption{"--warmup-frames="};
+    const std::string resolutionOption{"--resolution="};
+    const std::string memoryStatsOption{"--memory-stats="};
+    for (const auto& arg : args) {
+        if (arg.starts_with(framesOption))
+            setFramesInFlight(parseNumber(framesOption, arg.substr(framesOption.size()), 1));
+        else if (arg == headlessOption)
+            headless = true;
+        else if (arg.starts_with(headlessFramesOption))
+            headlessFrames = parseNumber(headlessFramesOption, arg.substr(headlessFramesOption.size()), 1);
+        else if (arg == compactVerticesOption)
+            compactVertices = true;
+        else if (arg == gpuCullingOption)
+            gpuCulling = true;
+        else if (arg.starts_with(instancesOption))
+            instanceCount = parseNumber(instancesOption, arg.substr(instancesOption.size()), 1);
+        else if (arg == cpuCullingOption)
+            cpuCulling = true;
+        else if (arg == cullBenchmarkOption)
+            cullBenchmark = true;
+        else if (arg.starts_with(recordThreadsOption))
+            recordThreads = parseNumber(recordThreadsOption, arg.substr(recordThreadsOption.size()), 0);
+        else if (arg == gpuProfileOption)
+            gpuProfiling = true;
+        else if (arg.starts_with(gpuProfileOption + "=")) {
+            gpuProfiling = true;
+            gpuProfilePath = arg.substr(gpuProfileOption.size() + 1);
+        }
+        else if (arg.starts_with(cpuTraceOption))
+            cpuTracePath = arg.substr(cpuTraceOption.size());
+        else if (arg == benchmarkOption)
+            benchmark = true;
+        else if (arg.starts_with(benchmarkOption + "=")) {
+            benchmark = true;
+            benchmarkPath = arg.substr(benchmarkOption.size() + 1);
+        }
+        else if (arg.starts_with(warmupFramesOption))
+            warmupFrames = parseNumber(warmupFramesOption, arg.substr(warmupFramesOption.size()), 0);
+        else if (arg.starts_with(resolutionOption)) {
+            // WIDTHxHEIGHT
+            auto value = arg.substr(resolutionOption.size());
+            auto separator = value.find('x');
+            if (separator == std::string::npos)
+                throw std::runtime_error("expected --resolution=WIDTHxHEIGHT");
+            width = static_cast<int>(parseNumber(resolutionOption, value.substr(0, separator), 1, std::numeric_limits<int>::max()));
+            height = static_cast<int>(parseNumber(resolutionOption, value.substr(separator + 1), 1, std::numeric_limits<int>::max()));
+        }
+        else if (arg.starts_with(memoryStatsOption))
+            memoryStatsPath = arg.substr(memoryStatsOption.size());
+        else if (modelName.empty())
+            modelName = arg;
+    }
+    // the benchmark never opens a window and needs the timestamps for the gpu frame time
+    if (benchmark) {
+        headless = true;
+        gpuProfiling = true;
+    }
+    // recording starts this early so the startup shows up in the trace as well
+    if (!cpuTracePath.empty())
+        CpuProfiler::get().start();
+}
+
+uint32_t Renderer::parseNumber(const std::string& option, const std::string& value, uint32_t minimum, uint32_t maximum) {
+    // unlike stoul this rejects signs, whitespace and anything trailing the digits
+    uint32_t number{};
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+    if (value.empty() || error != std::errc{} || end != value.data() + value.size() || number < minimum || number > maximum)
+        throw std::runtime_error(option + " expects a number from " + std::to_string(minimum) + " to " + std::to_string(maximum) + ", got \"" + value + "\"");
+    return number;
+}
 
+void Renderer::setFramesInFlight(uint32_t count) {
+    framesInFlight = std::clamp<uint32_t>(count, 1, maxFramesInFlight);
 }
 
 VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pCallback) {
@@ -1,6 +1,11 @@
 #pragma once
 #include "commonIncludes.h"
 #include "vma/vk_mem_alloc.h"
+#include "ThreadPool.h"
+#include "StateTracker.h"
+#include "FrameGraph.h"
+#include "CpuProfiler.h"
+#include "MemoryTelemetry.h"
 #include <random>
 // clang formats puts the glfw include above the vulkan include which breaks the program
 // remeber to put it in the correct place after formatting
@@ -14,6 +19,13 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance,
     VkDebugUtilsMessengerEXT callback,
     const VkAllocationCallbacks* pAllocator);
 
+class ScreenCapture;
+class PipelineCache;
+class GpuCulling;
+class CpuCulling;
+class ParallelRecorder;
+class GpuProfiler;
+class Benchmark;
 class Renderer {
   private:
 #ifdef NDEBUG
@@ -24,9 +36,21 @@ class Renderer {
     friend class PresentationEngine;
     friend class Graphics;
     friend class Resources;
-    GLFWwindow* window;
-    const int width{1920};
-    const int height{1080};
+    friend class ScreenCapture;
+    friend class UploadBatch;
+    friend class StagingRing;
+    friend class PipelineCache;
+    friend class GpuCulling;
+    friend class ParallelRecorder;
+    friend class TextureTable;
+    friend class FrameAllocator;
+    friend class FrameGraph;
+    friend class GpuProfiler;
+    friend class Benchmark;
+    GLFWwindow* window{nullptr};
+    // the size of the window, headless runs render at exactly this size
+    int width{1920};
+    int height{1080};
     // just a note to myself member variables are destroyed at the reverse order
     //  of declaration
 
@@ -66,6 +90,13 @@ class Renderer {
     vk::raii::PhysicalDevice m_physicalDevice{nullptr};
     vk::raii::Device m_device{nullptr};
     std::vector<const char*> deviceExtensions{VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME};
+    // BC formats are optional, without them compressed textures are decompressed on the cpu
+    bool textureCompressionBC{false};
+    // lets the culling pass decide how many draws run, otherwise the draw is always issued
+    bool drawIndirectCount{false};
+    bool descriptorIndexing{false};
+    // lets VMA read the real heap budgets instead of estimating them
+    bool memoryBudget{false};
     VmaAllocator allocator{};
     //  member variables for debugging
     std::vector<const char*> validationLayers{"VK_LAYER_KHRONOS_validation"};
@@ -74,10 +105,76 @@ class Renderer {
     PresentationEngine* pEngine{nullptr};
     Graphics* pGraphics{nullptr};
     Resources* pResources{nullptr};
+    std::unique_ptr<ScreenCapture> pCapture{};
+    std::unique_ptr<PipelineCache> pPipelineCache{};
+    std::unique_ptr<GpuCulling> pCulling{};
+    std::unique_ptr<CpuCulling> pCpuCulling{};
+    std::unique_ptr<ParallelRecorder> pRecorder{};
+    std::unique_ptr<FrameGraph> pFrameGraph{};
+    std::unique_ptr<GpuProfiler> pGpuProfiler{};
+    bool captureRequested{false};
+    // worker threads for cpu heavy work like decoding assets
+    ThreadPool threadPool{};
+    // layouts and last use of every image, all image barriers go through it
+    StateTracker stateTracker{};
+    // categories and budgets of every VMA allocation, all of them are freed through it
+    MemoryTelemetry memoryTelemetry{};
     std::mt19937_64 mt{};
     bool framebufferResized{false};
     std::vector<std::string> args{};
     std::string modelName{};
+    // how many frames the cpu may record ahead of the gpu
+    static constexpr uint32_t maxFramesInFlight{4};
+    uint32_t framesInFlight{2};
+    uint32_t currentFrame{};
+    // headless runs skip glfw, the surface and the swapchain entirely and
+    // only render into the blit image
+    bool headless{false};
+    uint32_t headlessFrames{1000};
+    // draws the viking mesh from Resources::CompactVertex instead of the full vertex
+    bool compactVertices{false};
+    // culls every instance in a compute pass and draws the viking mesh indirectly,
+    // without it only the first few instances are drawn
+    bool gpuCulling{false};
+    uint32_t instanceCount{500};
+    // the same culling on the cpu, the visible instances are streamed into a
+    // per-frame buffer, ignored when gpu culling is on
+    bool cpuCulling{false};
+    // only times the cpu culling paths and exits
+    bool cullBenchmark{false};
+    // how many secondary command buffers the scene is recorded into in parallel,
+    // zero records it inline into the frame's primary command buffer
+    uint32_t recordThreads{0};
+    // timestamps around the passes, an optional .json or .csv file gets the
+    // rolling statistics every few hundred frames
+    bool gpuProfiling{false};
+    std::string gpuProfilePath{};
+    // scoped cpu zones of every thread, written as a chrome trace on exit,
+    // the zones only exist in builds with CPU_PROFILER defined
+    std::string cpuTracePath{};
+    // a headless run of warm-up frames followed by the measured ones, the
+    // measured count is headlessFrames, the results optionally go to a json file
+    bool benchmark{false};
+    uint32_t warmupFrames{100};
+    std::string benchmarkPath{};
+    // the camera the scene is drawn from, either moved with the keys or along
+    // the scripted path, which depends on nothing but the frame number
+    float cameraPos{};
+    float cameraXPos{};
+    uint64_t frameNumber{};
+    // the memory telemetry is written to this json file every few hundred frames
+    std::string memoryStatsPath{};
+
+    // what every chunk of the scene needs, gathered once per frame so the
+    // chunks can be recorded on any thread
+    struct SceneDraw {
+        std::array<vk::Buffer, 2> vertexBuffers{};
+        uint32_t instanceCount{};
+        int textureIndex{};
+        // dynamic offsets of the camera matrices in the frame allocator
+        uint32_t uniformOffset{};
+        uint32_t skyUniformOffset{};
+    };
   public:
     enum Colors {
         Red,
@@ -92,12 +189,17 @@ class Renderer {
 
     Renderer(const std::vector<std::string>& args);
     void run(PresentationEngine* engine, Graphics* Graphics, Resources* resources);
+    // has to be called before run, the value is clamped to [1, maxFramesInFlight]
+    void setFramesInFlight(uint32_t count);
     ~Renderer();
 
   private:
+    // throws when value is not a plain decimal number in [minimum, maximum]
+    static uint32_t parseNumber(const std::string& option, const std::string& value, uint32_t minimum, uint32_t maximum = std::numeric_limits<uint32_t>::max());
     void initWindow();
     static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
     void initVulkan();
+    void loadAssets();
     void createInstance();
     uint32_t getQueueFamilyIndex();
     void createDevice();
@@ -106,17 +208,24 @@ class Renderer {
     bool checkDeviceExtensionSuppport(vk::raii::PhysicalDevice device);
     void createAllocator();
     void mainLoop();
+    void runHeadless();
     void recordCommandbuffer(vk::raii::CommandBuffer& commandBuffer, uint32_t imageIndex);
+    // records chunk's share of the viking instances, the last chunk also draws the skybox
+    void recordSceneChunk(vk::raii::CommandBuffer& commandBuffer, const SceneDraw& scene, uint32_t chunk, uint32_t chunkCount);
+    void addSwapchainPasses(FrameGraph::ImageHandle source, uint32_t imageIndex);
+    // blits the whole blit image into destination, which has to be in eTransferDstOptimal
+    void recordBlit(vk::raii::CommandBuffer& commandBuffer, vk::Image destination);
     void recordComputeCB(vk::raii::CommandBuffer& commandBuffer, uint32_t imageIndex);
+    void updateCamera();
     void createRandomNumberGenerator();
     void changeColor(Colors color);
     void drawFrame();
+    void drawHeadlessFrame();
+    bool isKeyPressed(int key);
     void cleanupSwapchain();
     void recreateSwapchain();
-    void transitionImageLayout(vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::raii::CommandBuffer& commandBuffer, const vk::Image& image, vk::ImageAspectFlags aspect, bool isCubeMap = false);
     Colors checkUserInput();
     int getUserInput();
-    void screenCapture();
 
     // functions for debugging
     std::vector<const char*> getRequiredExtensions();
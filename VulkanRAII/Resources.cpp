@@ -2,10 +2,15 @@
 #include "Graphics.h"
 #include "PresentationEngine.h"
 #include "Renderer.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
 #include "stb_image.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <cmath>
+#include <filesystem>
+#include <glm/gtc/packing.hpp>
 // the attachments refer to the vkImage views which itself is a view into
 // our swapchain images
 void Resources::createframebuffers() {
@@ -60,8 +65,10 @@ void Resources::createCommandbuffer() {
     vk::CommandBufferAllocateInfo allocInfo{};
     allocInfo.commandPool = *commandPool;
     allocInfo.level = vk::CommandBufferLevel::ePrimary;
-    allocInfo.commandBufferCount = 1;
-    commandBuffer = vk::raii::CommandBuffers{m_renderer.m_device, allocInfo};
+    allocInfo.commandBufferCount = static_cast<uint32_t>(frames.size());
+    vk::raii::CommandBuffers commandBuffers{m_renderer.m_device, allocInfo};
+    for (size_t index{}; index < frames.size(); index++)
+        frames[index].commandBuffer = std::move(commandBuffers[index]);
 }
 
 void Resources::createSyncObjects() {
@@ -70,97 +77,63 @@ void Resources::createSyncObjects() {
     vk::SemaphoreCreateInfo semaphoreInfo{};
 
     try {
-        inFlightFences = m_renderer.m_device.createFence(fenceInfo);
-        screenCaptureFence = m_renderer.m_device.createFence(vk::FenceCreateInfo{});
-        imageAvailableSemaphores = m_renderer.m_device.createSemaphore(semaphoreInfo);
-        finishedRenderingSemaphores = m_renderer.m_device.createSemaphore(semaphoreInfo);
-    } catch (vk::Error& err) {
-        std::cout << err.what();
-    }
-}
-
-uint32_t Resources::findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties) {
-    vk::PhysicalDeviceMemoryProperties memProperties{
-        m_renderer.m_physicalDevice.getMemoryProperties()};
-
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-            return i;
-    throw std::runtime_error("failed to find suitable memory type!");
-}
-
-void Resources::createBuffers(vk::raii::Buffer& buffer, vk::raii::DeviceMemory& memory, vk::DeviceSize size, vk::BufferUsageFlagBits usage) {
-    vk::BufferCreateInfo bufferInfo{};
-    bufferInfo.size = size;
-    uint32_t queueIndex = m_renderer.getQueueFamilyIndex();
-    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
-    bufferInfo.usage = usage;
-
-    try {
-        buffer = m_renderer.m_device.createBuffer(bufferInfo);
-    } catch (vk::Error& err) {
-        std::cout << err.what();
-    }
-    vk::MemoryRequirements memRequirments{buffer.getMemoryRequirements()};
-    vk::MemoryAllocateInfo allocInfo{};
-    allocInfo.allocationSize = memRequirments.size;
-    allocInfo.memoryTypeIndex = findMemoryType(
-        memRequirments.memoryTypeBits,
-        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-
-    try {
-        memory = m_renderer.m_device.allocateMemory(allocInfo);
-        buffer.bindMemory(*memory, 0);
+        for (auto& frame : frames) {
+            frame.inFlightFence = m_renderer.m_device.createFence(fenceInfo);
+            frame.imageAvailableSemaphore = m_renderer.m_device.createSemaphore(semaphoreInfo);
+            frame.finishedRenderingSemaphore = m_renderer.m_device.createSemaphore(semaphoreInfo);
+        }
     } catch (vk::Error& err) {
         std::cout << err.what();
     }
 }
 
-void Resources::mapMemory(vk::raii::DeviceMemory& memory, vk::DeviceSize size, const auto& vec) {
-    auto data = memory.mapMemory(0, size);
-    memcpy(data, vec.data(), size);
-}
-
 Resources::Resources(Renderer& renderer)
     : m_renderer{renderer}
-    , cube{renderer.allocator}
-    , viking{renderer.allocator}
-    , atlasCube{renderer.allocator} {
+    , cube{renderer.memoryTelemetry}
+    , viking{renderer.memoryTelemetry}
+    , atlasCube{renderer.memoryTelemetry} {
 }
 
 Resources::~Resources() {
+    for (auto& frame : frames) {
+        if (!frame.visibleInstanceAlloc)
+            continue;
+        frame.visibleInstanceBuffer.clear();
+        m_renderer.memoryTelemetry.free(frame.visibleInstanceAlloc);
+    }
     skyBoxImageView.clear();
     skyBoxImage.clear();
-    vmaFreeMemory(m_renderer.allocator, instanceAlloc);
-    vmaFreeMemory(m_renderer.allocator, skyBoxImageAlloc);
+    m_renderer.memoryTelemetry.free(instanceAlloc);
+    m_renderer.memoryTelemetry.free(skyBoxImageAlloc);
 }
 
 void Resources::createResources() {
+    PROFILE_ZONE("createResources");
     //createframebuffers();
+    frames.resize(m_renderer.framesInFlight);
     createCommandPools();
     createCommandbuffer();
     createSyncObjects();
-    vk::DeviceSize uboSize = static_cast<vk::DeviceSize>(sizeof(Renderer::MeshPushConstants) * 2);
-    createBuffers(uniformBuffer, uniformBufferMemory, uboSize, vk::BufferUsageFlagBits::eUniformBuffer);
-    uboPtr = uniformBufferMemory.mapMemory(0, uboSize);
-    vk::DeviceSize uboSize2 = static_cast<vk::DeviceSize>(sizeof(Renderer::MeshPushConstants));
-    createBuffers(uniformBuffer2, uniformBufferMemory2, uboSize2, vk::BufferUsageFlagBits::eUniformBuffer);
-    uboPtr2 = uniformBufferMemory2.mapMemory(0, uboSize2);
+    // every frame writes its constants into its own buffer, otherwise the cpu
+    // would overwrite matrices the previous frame is still reading
+    frameAllocator = std::make_unique<FrameAllocator>(m_renderer, static_cast<uint32_t>(frames.size()), 256 * 1024);
 }
 
 void Resources::createDescriptorPool() {
+    // the main and skybox sets are duplicated for every frame in flight
+    const uint32_t frameCount{m_renderer.framesInFlight};
     std::array<vk::DescriptorPoolSize, 3> poolSize{};
-    poolSize[0].type = vk::DescriptorType::eUniformBuffer;
-    poolSize[0].descriptorCount = 10;
+    poolSize[0].type = vk::DescriptorType::eUniformBufferDynamic;
+    poolSize[0].descriptorCount = 10 * frameCount;
     poolSize[1].type = vk::DescriptorType::eCombinedImageSampler;
-    poolSize[1].descriptorCount = 10;
+    poolSize[1].descriptorCount = 10 * frameCount;
     poolSize[2].type = vk::DescriptorType::eStorageImage;
     poolSize[2].descriptorCount = 1;
 
     vk::DescriptorPoolCreateInfo createInfo{};
     createInfo.poolSizeCount = poolSize.size();
     createInfo.pPoolSizes = poolSize.data();
-    createInfo.maxSets = 10;
+    createInfo.maxSets = 10 * frameCount;
     createInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
 
     try {
@@ -171,59 +144,42 @@ void Resources::createDescriptorPool() {
 }
 
 void Resources::allocateDescriptorSets() {
+    std::vector<vk::DescriptorSetLayout> layouts(frames.size(), *m_renderer.pGraphics->descriptorSetLayout);
     vk::DescriptorSetAllocateInfo allocateInfo{};
-    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
     allocateInfo.descriptorPool = *descriptorPool;
-    allocateInfo.pSetLayouts = &*m_renderer.pGraphics->descriptorSetLayout;
+    allocateInfo.pSetLayouts = layouts.data();
 
     try {
-        descriptorSet = m_renderer.m_device.allocateDescriptorSets(allocateInfo);
+        auto descriptorSets = m_renderer.m_device.allocateDescriptorSets(allocateInfo);
+        for (size_t index{}; index < frames.size(); index++)
+            frames[index].descriptorSet = std::move(descriptorSets[index]);
     } catch (vk::Error& err) {
         std::cout << err.what();
     }
 
-    vk::DescriptorBufferInfo bufferInfo{};
-    bufferInfo.buffer = *uniformBuffer;
-    bufferInfo.offset = 0;
-    bufferInfo.range = sizeof(Renderer::MeshPushConstants) * 2;
-
-    vk::DescriptorImageInfo imageInfo{};
-    imageInfo.imageView = *atlasCube.imageView;
-    imageInfo.sampler = *atlasCube.sampler;
-    imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-
-    vk::DescriptorImageInfo imageInfo2{};
-    imageInfo2.imageView = *viking.imageView;
-    imageInfo2.sampler = *viking.sampler;
-    imageInfo2.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-
-    vk::DescriptorImageInfo imageInfo3{};
-    imageInfo3.imageView = *texImageView3;
-    imageInfo3.sampler = *texSampler3;
-    imageInfo3.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-
-    vk::DescriptorImageInfo imageInfos[3] = {imageInfo, imageInfo2, imageInfo3};
-    std::array<vk::WriteDescriptorSet, 2> descriptorWrite{};
-    descriptorWrite[0].dstSet = *descriptorSet[0];
-    descriptorWrite[0].dstBinding = 0;
-    descriptorWrite[0].dstArrayElement = 0;
-    descriptorWrite[0].descriptorType = vk::DescriptorType::eUniformBuffer;
-    descriptorWrite[0].descriptorCount = 1;
-    descriptorWrite[0].pBufferInfo = &bufferInfo;
-    
-    // dstArray refers to an array of descriptors pointing to an array of buffers/samplers bound that that sets binding slot
-    // dstArrayElement is the index of that element inside the array
-    descriptorWrite[1].dstSet = *descriptorSet[0];
-    descriptorWrite[1].dstBinding = 1;
-    descriptorWrite[1].dstArrayElement = 0;
-    descriptorWrite[1].descriptorType = vk::DescriptorType::eCombinedImageSampler;
-    descriptorWrite[1].descriptorCount = 3;
-    descriptorWrite[1].pImageInfo = imageInfos;
-
-    m_renderer.m_device.updateDescriptorSets(descriptorWrite, nullptr);
+    for (size_t index{}; index < frames.size(); index++) {
+        auto& frame = frames[index];
+        // the range is one draw's worth, the dynamic offset picks the slice
+        vk::DescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = frameAllocator->getBuffer(static_cast<uint32_t>(index));
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(Renderer::MeshPushConstants) * 2;
+
+        // the textures are not part of this set, they live in the texture table
+        vk::WriteDescriptorSet descriptorWrite{};
+        descriptorWrite.dstSet = *frame.descriptorSet;
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pBufferInfo = &bufferInfo;
+
+        m_renderer.m_device.updateDescriptorSets(descriptorWrite, nullptr);
+    }
 }
 
-vk::raii::Buffer Resources::createBuffer(vk::BufferUsageFlags usage, vk::DeviceSize size, VmaAllocationCreateFlags createFlags, VkMemoryPropertyFlags propertyFlags, VmaAllocation& allocation) {
+vk::raii::Buffer Resources::createBuffer(vk::BufferUsageFlags usage, vk::DeviceSize size, VmaAllocationCreateFlags createFlags, VkMemoryPropertyFlags propertyFlags, VmaAllocation& allocation, MemoryTelemetry::Category category) {
     vk::BufferCreateInfo bufferInfo{};
     bufferInfo.size = size;
     bufferInfo.usage = usage;
@@ -237,6 +193,7 @@ vk::raii::Buffer Resources::createBuffer(vk::BufferUsageFlags usage, vk::DeviceS
 
     if (result != VkResult::VK_SUCCESS)
         std::cerr << "creating vkBuffer failed\n";
+    m_renderer.memoryTelemetry.track(allocation, category);
 
     return vk::raii::Buffer{m_renderer.m_device, buffer};
 }
@@ -267,95 +224,336 @@ void* Resources::mapPersistentMemory(const VmaAllocator& allocator, const VmaAll
 }
 
 void Resources::allocateSkyDescriptorSet() {
+    std::vector<vk::DescriptorSetLayout> layouts(frames.size(), *m_renderer.pGraphics->skyDescriptorSetLayout);
     vk::DescriptorSetAllocateInfo allocateInfo{};
-    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
     allocateInfo.descriptorPool = *descriptorPool;
-    allocateInfo.pSetLayouts = &*m_renderer.pGraphics->skyDescriptorSetLayout;
+    allocateInfo.pSetLayouts = layouts.data();
 
     try {
-        skyDescriptorSet = m_renderer.m_device.allocateDescriptorSets(allocateInfo);
+        auto descriptorSets = m_renderer.m_device.allocateDescriptorSets(allocateInfo);
+        for (size_t index{}; index < frames.size(); index++)
+            frames[index].skyDescriptorSet = std::move(descriptorSets[index]);
     } catch (vk::Error& err) {
         std::cout << err.what();
     }
-   
-    vk::DescriptorBufferInfo bufferInfo{};
-    bufferInfo.buffer = *uniformBuffer2;
-    bufferInfo.offset = 0;
-    bufferInfo.range = sizeof(Renderer::MeshPushConstants);
 
     vk::DescriptorImageInfo skyBoxInfo{};
     skyBoxInfo.imageView = *skyBoxImageView;
     skyBoxInfo.sampler = *skyBoxSampler;
     skyBoxInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
 
-    std::array<vk::WriteDescriptorSet, 2> descriptorWrite{};
-    descriptorWrite[0].dstSet = *skyDescriptorSet[0];
-    descriptorWrite[0].dstBinding = 0;
-    descriptorWrite[0].dstArrayElement = 0;
-    descriptorWrite[0].descriptorType = vk::DescriptorType::eUniformBuffer;
-    descriptorWrite[0].descriptorCount = 1;
-    descriptorWrite[0].pBufferInfo = &bufferInfo;
+    for (size_t index{}; index < frames.size(); index++) {
+        auto& frame = frames[index];
+        vk::DescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = frameAllocator->getBuffer(static_cast<uint32_t>(index));
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(Renderer::MeshPushConstants);
+
+        std::array<vk::WriteDescriptorSet, 2> descriptorWrite{};
+        descriptorWrite[0].dstSet = *frame.skyDescriptorSet;
+        descriptorWrite[0].dstBinding = 0;
+        descriptorWrite[0].dstArrayElement = 0;
+        descriptorWrite[0].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+        descriptorWrite[0].descriptorCount = 1;
+        descriptorWrite[0].pBufferInfo = &bufferInfo;
+
+        descriptorWrite[1].dstSet = *frame.skyDescriptorSet;
+        descriptorWrite[1].dstBinding = 1;
+        descriptorWrite[1].dstArrayElement = 0;
+        descriptorWrite[1].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+        descriptorWrite[1].descriptorCount = 1;
+        descriptorWrite[1].pImageInfo = &skyBoxInfo;
+
+        m_renderer.m_device.updateDescriptorSets(descriptorWrite, nullptr);
+    }
+}
 
-    descriptorWrite[1].dstSet = *skyDescriptorSet[0];
-    descriptorWrite[1].dstBinding = 1;
-    descriptorWrite[1].dstArrayElement = 0;
-    descriptorWrite[1].descriptorType = vk::DescriptorType::eCombinedImageSampler;
-    descriptorWrite[1].descriptorCount = 1;
-    descriptorWrite[1].pImageInfo = &skyBoxInfo;
+void Resources::ImageData::PixelDeleter::operator()(unsigned char* pixels) const {
+    stbi_image_free(pixels);
+}
 
-    m_renderer.m_device.updateDescriptorSets(descriptorWrite, nullptr);
+vk::DeviceSize Resources::ImageData::getSize() const {
+    return static_cast<vk::DeviceSize>(width) * height * 4;
 }
 
-void Resources::loadImage(const std::string& imageName, vk::raii::Image& image, vk::raii::ImageView& imageView, VmaAllocation& imageAlloc, vk::raii::Sampler& sampler) {
-    int texWidth{};
-    int texHeight{};
+Resources::ImageData Resources::decodeImage(const std::string& imageName) {
+    PROFILE_ZONE("decodeImage");
+    ImageData imageData{};
     int texChannels{};
-    stbi_uc* pixels{nullptr};
-    pixels = stbi_load(imageName.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    vk::DeviceSize imageSize{static_cast<vk::DeviceSize>(texWidth * texHeight * 4)};
-
-    if (!pixels)
-        throw std::runtime_error("failed to load image!");
-
-    vk::raii::Buffer stagingBuffer{nullptr};
-    VmaAllocation allocation{nullptr};
-    stagingBuffer = createBuffer(vk::BufferUsageFlagBits::eTransferSrc, imageSize, VmaAllocationCreateFlagBits::VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, 0, allocation);
-    mapMemory(m_renderer.allocator, allocation, pixels, imageSize);
-
-    image = createImage(texWidth, texHeight, vk::Format::eR8G8B8A8Srgb, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, 0, VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_renderer.allocator, imageAlloc);
-
-    auto commandBuffer{createSingleTimeCB()};
-    vk::CommandBufferBeginInfo beginInfo{};
-    beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-    commandBuffer.begin(beginInfo);
-
-    m_renderer.transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, commandBuffer, *image, vk::ImageAspectFlagBits::eColor);
-    copyBufferToImage(commandBuffer, stagingBuffer, *image, static_cast<std::uint32_t>(texWidth), static_cast<std::uint32_t>(texHeight));
-    m_renderer.transitionImageLayout(vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, commandBuffer, *image, vk::ImageAspectFlagBits::eColor);
-
-   commandBuffer.end();
-
-    vk::SubmitInfo submitInfo{};
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &*commandBuffer;
-    m_renderer.m_queue.submit(submitInfo);
-    m_renderer.m_queue.waitIdle();
-    imageView = createImageView(*image, vk::Format::eR8G8B8A8Srgb, vk::ImageAspectFlagBits::eColor);
-    sampler = createSampler();
-    commandBuffer.clear();
-    stbi_image_free(pixels);
-    stagingBuffer.clear();
-    vmaFreeMemory(m_renderer.allocator, allocation);
-    
+    imageData.pixels.reset(stbi_load(imageName.c_str(), &imageData.width, &imageData.height, &texChannels, STBI_rgb_alpha));
+
+    if (!imageData.pixels)
+        throw std::runtime_error("failed to load image " + imageName);
+    return imageData;
+}
+
+Resources::ImageData Resources::decodeTexture(const std::string& imageName) {
+    ImageData imageData{};
+    if (CompressedTexture::isCompressedFile(imageName)) {
+        imageData.compressed = std::make_unique<CompressedTexture>(CompressedTexture::load(imageName));
+        return imageData;
+    }
+
+    for (const auto& extension : {".ktx2", ".dds"}) {
+        auto path = std::filesystem::path{imageName}.replace_extension(extension);
+        if (std::filesystem::exists(path)) {
+            imageData.compressed = std::make_unique<CompressedTexture>(CompressedTexture::load(path.string()));
+            return imageData;
+        }
+    }
+    return decodeImage(imageName);
+}
+
+Resources::ModelData Resources::decodeModel(const std::string& name, bool customUV) {
+    PROFILE_ZONE("decodeModel");
+    ModelData model{};
+    if (MeshCache::load(name, customUV, model))
+        return model;
+
+    loadModel(name, model.vertices, model.indices, customUV);
+    model.name = name;
+    model.stats = MeshOptimizer::optimize(model.vertices, model.indices);
+    MeshCache::store(name, customUV, model);
+    return model;
+}
+
+void Resources::loadImage(const std::string& imageName, vk::raii::Image& image, vk::raii::ImageView& imageView, VmaAllocation& imageAlloc, vk::raii::Sampler& sampler) {
+    loadImage(decodeImage(imageName), image, imageView, imageAlloc, sampler);
+}
+
+void Resources::loadImage(const ImageData& imageData, vk::raii::Image& image, vk::raii::ImageView& imageView, VmaAllocation& imageAlloc, vk::raii::Sampler& sampler) {
+    if (imageData.compressed) {
+        loadCompressedImage(*imageData.compressed, image, imageView, imageAlloc, sampler);
+        return;
+    }
+
+    const vk::Format format{vk::Format::eR8G8B8A8Srgb};
+    uint32_t mipLevels{getMipLevels(imageData.width, imageData.height)};
+    // the blit cascade reads every level but the last one back as a transfer source
+    image = createImage(imageData.width, imageData.height, format, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, 0, VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_renderer.allocator, imageAlloc, MemoryTelemetry::Category::Textures, mipLevels);
+    uploadTexture(getUploadBatch(), {&imageData}, *image, format, mipLevels);
+
+    imageView = createImageView(*image, format, vk::ImageAspectFlagBits::eColor, mipLevels);
+    sampler = createSampler(mipLevels);
+}
+
+uint32_t Resources::getMipLevels(int width, int height) {
+    uint32_t mipLevels{1};
+    for (int size{std::max(width, height)}; size > 1; size /= 2)
+        mipLevels++;
+    return mipLevels;
+}
+
+bool Resources::supportsLinearBlit(vk::Format format) {
+    auto features = m_renderer.m_physicalDevice.getFormatProperties(format).optimalTilingFeatures;
+    const auto required = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    return (features & required) == required;
+}
+
+bool Resources::supportsCompressedFormat(vk::Format format) {
+    if (!m_renderer.textureCompressionBC)
+        return false;
+    auto features = m_renderer.m_physicalDevice.getFormatProperties(format).optimalTilingFeatures;
+    const auto required = vk::FormatFeatureFlagBits::eSampledImage | vk::FormatFeatureFlagBits::eTransferDst;
+    return (features & required) == required;
+}
+
+void Resources::loadCompressedImage(const CompressedTexture& texture, vk::raii::Image& image, vk::raii::ImageView& imageView, VmaAllocation& imageAlloc, vk::raii::Sampler& sampler) {
+    // block formats can't be blit so the mip chain is whatever the file has
+    const auto mipLevels = static_cast<uint32_t>(texture.levels.size());
+    bool native{supportsCompressedFormat(texture.getFormat())};
+    vk::Format format{native ? texture.getFormat() : texture.getDecompressedFormat()};
+    if (!native)
+        std::cout << "block compressed textures are not supported, decompressing on the cpu\n";
+
+    image = createImage(texture.width, texture.height, format, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, 0, VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_renderer.allocator, imageAlloc, MemoryTelemetry::Category::Textures, mipLevels);
+
+    auto& uploads = getUploadBatch();
+    auto& commandBuffer = uploads.getCommandBuffer();
+    auto& states = m_renderer.stateTracker;
+    states.registerImage(*image, vk::ImageAspectFlagBits::eColor, mipLevels);
+    states.use(*image, StateTracker::Usage::TransferDst, true);
+    states.flush(commandBuffer);
+    for (uint32_t levelIndex{}; levelIndex < mipLevels; levelIndex++) {
+        const auto& level = texture.levels[levelIndex];
+        UploadBatch::StagingRange staging{};
+        if (native) {
+            staging = uploads.stage(texture.data.data() + level.offset, level.size);
+        } else {
+            auto pixels = texture.decompress(levelIndex);
+            staging = uploads.stage(pixels.data(), pixels.size());
+        }
+
+        vk::BufferImageCopy region{};
+        region.bufferOffset = staging.offset;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+        region.imageSubresource.mipLevel = levelIndex;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = vk::Offset3D{0, 0, 0};
+        region.imageExtent = vk::Extent3D{level.width, level.height, 1};
+        commandBuffer.copyBufferToImage(staging.buffer, *image, vk::ImageLayout::eTransferDstOptimal, region);
+    }
+    states.use(*image, StateTracker::Usage::FragmentShaderRead);
+    states.flush(commandBuffer);
+
+    imageView = createImageView(*image, format, vk::ImageAspectFlagBits::eColor, mipLevels);
+    sampler = createSampler(mipLevels);
+}
+
+void Resources::uploadTexture(UploadBatch& uploads, const std::vector<const ImageData*>& layers, const vk::Image& image, vk::Format format, uint32_t mipLevels, bool isCubeMap) {
+    auto& commandBuffer = uploads.getCommandBuffer();
+    const int width{layers[0]->width};
+    const int height{layers[0]->height};
+    const auto layerCount = static_cast<uint32_t>(layers.size());
+    auto& states = m_renderer.stateTracker;
+    states.registerImage(image, vk::ImageAspectFlagBits::eColor, mipLevels, layerCount);
+    states.use(image, StateTracker::Usage::TransferDst, true);
+    states.flush(commandBuffer);
+
+    vk::BufferImageCopy region{};
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = vk::Offset3D{0, 0, 0};
+
+    if (supportsLinearBlit(format)) {
+        const vk::DeviceSize layerSize{layers[0]->getSize()};
+        auto staging = uploads.stage(layerSize * layerCount);
+        std::vector<vk::BufferImageCopy> regions{};
+        for (uint32_t layer{}; layer < layerCount; layer++) {
+            memcpy(static_cast<char*>(staging.ptr) + layerSize * layer, layers[layer]->pixels.get(), layerSize);
+            region.bufferOffset = staging.offset + layerSize * layer;
+            region.imageSubresource.mipLevel = 0;
+            region.imageSubresource.baseArrayLayer = layer;
+            region.imageExtent = vk::Extent3D{static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1};
+            regions.push_back(region);
+        }
+        commandBuffer.copyBufferToImage(staging.buffer, image, vk::ImageLayout::eTransferDstOptimal, regions);
+        generateMipmaps(commandBuffer, image, width, height, mipLevels, layerCount);
+        return;
+    }
+
+    // without linear filtered blits the whole chain is built on the cpu and
+    // every level is copied in directly
+    for (uint32_t layer{}; layer < layerCount; layer++) {
+        std::vector<vk::DeviceSize> levelOffsets{};
+        auto mipChain = generateMipChain(*layers[layer], mipLevels, levelOffsets);
+        auto staging = uploads.stage(mipChain.data(), mipChain.size());
+        std::vector<vk::BufferImageCopy> regions{};
+        for (uint32_t level{}; level < mipLevels; level++) {
+            region.bufferOffset = staging.offset + levelOffsets[level];
+            region.imageSubresource.mipLevel = level;
+            region.imageSubresource.baseArrayLayer = layer;
+            region.imageExtent = vk::Extent3D{std::max(static_cast<uint32_t>(width) >> level, 1u), std::max(static_cast<uint32_t>(height) >> level, 1u), 1};
+            regions.push_back(region);
+        }
+        commandBuffer.copyBufferToImage(staging.buffer, image, vk::ImageLayout::eTransferDstOptimal, regions);
+    }
+    states.use(image, StateTracker::Usage::FragmentShaderRead);
+    states.flush(commandBuffer);
+}
+
+void Resources::generateMipmaps(vk::raii::CommandBuffer& commandBuffer, const vk::Image& image, int width, int height, uint32_t mipLevels, uint32_t layerCount) {
+    auto& states = m_renderer.stateTracker;
+    int32_t mipWidth{width};
+    int32_t mipHeight{height};
+    for (uint32_t level{1}; level < mipLevels; level++) {
+        // the previous level was just written, it becomes the source of this blit,
+        // the one before it is done being read and goes out in the same barrier
+        states.use(image, StateTracker::Usage::TransferSrc, false, level - 1, 1);
+        if (level > 1)
+            states.use(image, StateTracker::Usage::FragmentShaderRead, false, level - 2, 1);
+        states.flush(commandBuffer);
+
+        int32_t nextWidth{std::max(mipWidth / 2, 1)};
+        int32_t nextHeight{std::max(mipHeight / 2, 1)};
+        vk::ImageBlit blit{};
+        blit.srcOffsets[0] = vk::Offset3D{0, 0, 0};
+        blit.srcOffsets[1] = vk::Offset3D{mipWidth, mipHeight, 1};
+        blit.srcSubresource = vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, level - 1, 0, layerCount};
+        blit.dstOffsets[0] = vk::Offset3D{0, 0, 0};
+        blit.dstOffsets[1] = vk::Offset3D{nextWidth, nextHeight, 1};
+        blit.dstSubresource = vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, level, 0, layerCount};
+        commandBuffer.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, blit, vk::Filter::eLinear);
+
+        mipWidth = nextWidth;
+        mipHeight = nextHeight;
+    }
+
+    // the levels already handed over are skipped, only the last two still need a barrier
+    states.use(image, StateTracker::Usage::FragmentShaderRead);
+    states.flush(commandBuffer);
 }
 
-vk::raii::Image Resources::createImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, VkMemoryPropertyFlags propertyFlags, VmaAllocationCreateFlags createFlags, const VmaAllocator& allocator, VmaAllocation& allocation) {
+std::vector<unsigned char> Resources::generateMipChain(const ImageData& imageData, uint32_t mipLevels, std::vector<vk::DeviceSize>& levelOffsets) {
+    // the textures are srgb so texels are averaged in linear space, the same
+    // thing a linear blit does
+    static const auto toLinear = [] {
+        std::array<float, 256> table{};
+        for (int index{}; index < 256; index++) {
+            float value{index / 255.0f};
+            table[index] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+        }
+        return table;
+    }();
+    const auto toSrgb = [](float value) {
+        value = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+        return static_cast<unsigned char>(std::clamp(value * 255.0f + 0.5f, 0.0f, 255.0f));
+    };
+
+    std::vector<unsigned char> mipChain(imageData.pixels.get(), imageData.pixels.get() + imageData.getSize());
+    levelOffsets.assign(1, 0);
+    int srcWidth{imageData.width};
+    int srcHeight{imageData.height};
+    for (uint32_t level{1}; level < mipLevels; level++) {
+        int dstWidth{std::max(srcWidth / 2, 1)};
+        int dstHeight{std::max(srcHeight / 2, 1)};
+        vk::DeviceSize srcOffset{levelOffsets.back()};
+        vk::DeviceSize dstOffset{mipChain.size()};
+        levelOffsets.push_back(dstOffset);
+        mipChain.resize(dstOffset + static_cast<vk::DeviceSize>(dstWidth) * dstHeight * 4);
+
+        for (int y{}; y < dstHeight; y++) {
+            for (int x{}; x < dstWidth; x++) {
+                // odd sizes clamp at the edge instead of reading past it
+                int x0{std::min(x * 2, srcWidth - 1)};
+                int x1{std::min(x * 2 + 1, srcWidth - 1)};
+                int y0{std::min(y * 2, srcHeight - 1)};
+                int y1{std::min(y * 2 + 1, srcHeight - 1)};
+                const unsigned char* texels[4]{
+                    &mipChain[srcOffset + (static_cast<vk::DeviceSize>(y0) * srcWidth + x0) * 4],
+                    &mipChain[srcOffset + (static_cast<vk::DeviceSize>(y0) * srcWidth + x1) * 4],
+                    &mipChain[srcOffset + (static_cast<vk::DeviceSize>(y1) * srcWidth + x0) * 4],
+                    &mipChain[srcOffset + (static_cast<vk::DeviceSize>(y1) * srcWidth + x1) * 4]};
+                unsigned char* dst{&mipChain[dstOffset + (static_cast<vk::DeviceSize>(y) * dstWidth + x) * 4]};
+                for (int channel{}; channel < 3; channel++) {
+                    float sum{};
+                    for (auto texel : texels)
+                        sum += toLinear[texel[channel]];
+                    dst[channel] = toSrgb(sum / 4.0f);
+                }
+                int alpha{texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3]};
+                dst[3] = static_cast<unsigned char>((alpha + 2) / 4);
+            }
+        }
+        srcWidth = dstWidth;
+        srcHeight = dstHeight;
+    }
+    return mipChain;
+}
+
+vk::raii::Image Resources::createImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, VkMemoryPropertyFlags propertyFlags, VmaAllocationCreateFlags createFlags, const VmaAllocator& allocator, VmaAllocation& allocation, MemoryTelemetry::Category category, uint32_t mipLevels) {
     vk::ImageCreateInfo imageInfo{};
     imageInfo.imageType = vk::ImageType::e2D;
     imageInfo.extent.width = static_cast<uint32_t>(width);
     imageInfo.extent.height = static_cast<uint32_t>(height);
     imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
+    imageInfo.mipLevels = mipLevels;
     imageInfo.arrayLayers = 1;
     imageInfo.format = format;
     imageInfo.usage = usage;
@@ -375,6 +573,7 @@ vk::raii::Image Resources::createImage(uint32_t width, uint32_t height, vk::Form
     if (result != VK_SUCCESS) {
         throw std::runtime_error("image creation failed");
     }
+    m_renderer.memoryTelemetry.track(allocation, category);
     return vk::raii::Image{m_renderer.m_device, image};
 }
 
@@ -389,7 +588,7 @@ vk::raii::CommandBuffer Resources::createSingleTimeCB() {
     return commandBuffer;
 }
 
-vk::raii::ImageView Resources::createImageView(const vk::Image& image, vk::Format format, vk::ImageAspectFlags aspectFlags) {
+vk::raii::ImageView Resources::createImageView(const vk::Image& image, vk::Format format, vk::ImageAspectFlags aspectFlags, uint32_t mipLevels) {
     vk::ImageViewCreateInfo createInfo{};
     createInfo.image = image;
     createInfo.viewType = vk::ImageViewType::e2D;
@@ -400,17 +599,17 @@ vk::raii::ImageView Resources::createImageView(const vk::Image& image, vk::Forma
         vk::ComponentSwizzle::eIdentity, vk::ComponentSwizzle::eIdentity};
     createInfo.components = mappings;
 
-    // base	MipmapLevel = 0, levelcount = 1, baseArrayLayer = 0, layerCount
+    // base	MipmapLevel = 0, levelcount = mipLevels, baseArrayLayer = 0, layerCount
     // =
     // 1
     vk::ImageSubresourceRange imageSubResource{aspectFlags,
-        0, 1, 0, 1};
+        0, mipLevels, 0, 1};
     createInfo.subresourceRange = imageSubResource;
 
     return m_renderer.m_device.createImageView(createInfo);
 }
 
-vk::raii::Sampler Resources::createSampler() {
+vk::raii::Sampler Resources::createSampler(uint32_t mipLevels) {
     vk::PhysicalDeviceProperties deviceProperties = m_renderer.m_physicalDevice.getProperties();
     vk::SamplerCreateInfo samplerInfo{};
     samplerInfo.magFilter = vk::Filter::eLinear;
@@ -427,31 +626,11 @@ vk::raii::Sampler Resources::createSampler() {
     samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
     samplerInfo.mipLodBias = 0.0f;
     samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>(mipLevels);
    
     return m_renderer.m_device.createSampler(samplerInfo);
 }
 
-void Resources::createDepthBuffer() {
-    depthImage = createImage(m_renderer.pEngine->swapChainExtent.width, m_renderer.pEngine->swapChainExtent.width, vk::Format::eD32Sfloat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferDst, VmaAllocationCreateFlagBits::VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT, VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_renderer.allocator, depthAlloc);
-    depthImageView = createImageView(*depthImage, vk::Format::eD32Sfloat, vk::ImageAspectFlagBits::eDepth);
-    auto cb = createSingleTimeCB();
-    
-    vk::CommandBufferBeginInfo beginInfo{};
-    beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-    cb.begin(beginInfo);
-
-    m_renderer.transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthAttachmentOptimal, cb, *depthImage, vk::ImageAspectFlagBits::eDepth);
-    cb.end();
-
-    vk::SubmitInfo submitInfo{};
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &*cb;
-    m_renderer.m_queue.submit(submitInfo);
-    m_renderer.m_queue.waitIdle();
-
-}
-
 void Resources::allocateComputeDescSet() {
     vk::DescriptorSetAllocateInfo allocateInfo{};
     allocateInfo.descriptorSetCount = 1;
@@ -480,41 +659,37 @@ void Resources::allocateComputeDescSet() {
 }
 
 void Resources::createSkyBox() {
-    int texWidth{};
-    int texHeight{};
-    int texChannels{};
-    std::vector<stbi_uc*> pixels{};
-    pixels.resize(6);
-    vk::DeviceSize imageSize{};
-    int index{};
-    for (const auto& face : m_renderer.faces) {
-        pixels[index] = stbi_load(face.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-        imageSize = static_cast<vk::DeviceSize>(texWidth * texHeight * 4);
-
-        if (!pixels[index])
-            throw std::runtime_error("failed to load image!");
-        index++;
-    }
- 
-    vk::raii::Buffer stagingBuffer{nullptr};
-    VmaAllocation allocation{nullptr};
-    stagingBuffer = createBuffer(vk::BufferUsageFlagBits::eTransferSrc, imageSize * 6, VmaAllocationCreateFlagBits::VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, 0, allocation);
-    auto ptr = mapPersistentMemory(m_renderer.allocator, allocation, imageSize * 6);
+    std::vector<ImageData> faceImages{};
+    for (const auto& face : m_renderer.faces)
+        faceImages.push_back(decodeImage(face));
+    createSkyBox(faceImages);
+}
+
+void Resources::createSkyBox(const std::vector<ImageData>& faceImages) {
+    PROFILE_ZONE("createSkyBox");
     const int cubeFaces{6};
-    for (int index{}; index < cubeFaces; index++) {
-        uint64_t src = reinterpret_cast<uint64_t>(ptr) + imageSize * index;
-        memcpy(reinterpret_cast<void*>(src), pixels[index], imageSize);
+    if (faceImages.size() != cubeFaces)
+        throw std::runtime_error("a skybox needs exactly six faces");
+
+    int texWidth{faceImages[0].width};
+    int texHeight{faceImages[0].height};
+    std::vector<const ImageData*> layers{};
+    for (const auto& face : faceImages) {
+        if (face.width != texWidth || face.height != texHeight)
+            throw std::runtime_error("skybox faces have different sizes");
+        layers.push_back(&face);
     }
+    uint32_t mipLevels{getMipLevels(texWidth, texHeight)};
 
     vk::ImageCreateInfo imageInfo{};
     imageInfo.imageType = vk::ImageType::e2D;
     imageInfo.extent.width = static_cast<uint32_t>(texWidth);
     imageInfo.extent.height = static_cast<uint32_t>(texHeight);
     imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
+    imageInfo.mipLevels = mipLevels;
     imageInfo.arrayLayers = 6;
     imageInfo.format = vk::Format::eR8G8B8A8Srgb;
-    imageInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+    imageInfo.usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
     imageInfo.initialLayout = vk::ImageLayout::eUndefined;
     imageInfo.tiling = vk::ImageTiling::eOptimal;
     imageInfo.sharingMode = vk::SharingMode::eExclusive;
@@ -531,48 +706,11 @@ void Resources::createSkyBox() {
 
     if (result != VK_SUCCESS)
         throw std::runtime_error("image creation failed");
+    m_renderer.memoryTelemetry.track(skyBoxImageAlloc, MemoryTelemetry::Category::Textures);
 
     skyBoxImage = {m_renderer.m_device, image};
 
-    for (int index{}; index < cubeFaces; index++) {
-        stbi_image_free(pixels[index]);
-    }
-
-    std::array<vk::BufferImageCopy, 6> copyRegions{};
-    uint32_t i{};
-    for (auto& region : copyRegions) {
-
-        region.bufferOffset = imageSize * i;
-        region.bufferRowLength = 0;
-        region.bufferImageHeight = 0;
-
-        region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-        region.imageSubresource.mipLevel = 0;
-        region.imageSubresource.baseArrayLayer = i;
-        region.imageSubresource.layerCount = 1;
-
-        region.imageOffset = vk::Offset3D{0, 0, 0};
-        region.imageExtent = vk::Extent3D{
-            static_cast<uint32_t>(texWidth),
-            static_cast<uint32_t> (texHeight),
-            1};
-        i++;
-    }
-    
-    auto commandBuffer{createSingleTimeCB()};
-    vk::CommandBufferBeginInfo beginInfo{};
-    beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-    commandBuffer.begin(beginInfo);
-    m_renderer.transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, commandBuffer, *skyBoxImage, vk::ImageAspectFlagBits::eColor, true);
-    commandBuffer.copyBufferToImage(*stagingBuffer, *skyBoxImage, vk::ImageLayout::eTransferDstOptimal, copyRegions);
-    m_renderer.transitionImageLayout(vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, commandBuffer, *skyBoxImage, vk::ImageAspectFlagBits::eColor, true);
-    commandBuffer.end();
-
-    vk::SubmitInfo submitInfo{};
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &*commandBuffer;
-    m_renderer.m_queue.submit(submitInfo);
-    m_renderer.m_device.waitIdle();
+    uploadTexture(getUploadBatch(), layers, *skyBoxImage, vk::Format::eR8G8B8A8Srgb, mipLevels, true);
 
     vk::ImageViewCreateInfo createInfo{};
     createInfo.image = image;
@@ -584,11 +722,11 @@ void Resources::createSkyBox() {
         vk::ComponentSwizzle::eIdentity, vk::ComponentSwizzle::eIdentity};
     createInfo.components = mappings;
 
-    // base	MipmapLevel = 0, levelcount = 1, baseArrayLayer = 0, layerCount
+    // base	MipmapLevel = 0, levelcount = mipLevels, baseArrayLayer = 0, layerCount
     // =
-    // 1
+    // 6
     vk::ImageSubresourceRange imageSubResource{vk::ImageAspectFlagBits::eColor,
-        0, 1, 0, 6};
+        0, mipLevels, 0, 6};
     createInfo.subresourceRange = imageSubResource;
     skyBoxImageView = m_renderer.m_device.createImageView(createInfo);
 
@@ -608,12 +746,9 @@ void Resources::createSkyBox() {
     samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
     samplerInfo.mipLodBias = 0.0f;
     samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>(mipLevels);
     
     skyBoxSampler = m_renderer.m_device.createSampler(samplerInfo);
-    stagingBuffer.clear();
-    vmaUnmapMemory(m_renderer.allocator, allocation);
-    vmaFreeMemory(m_renderer.allocator, allocation);
 }
 
 void Resources::createInstanceData() {
@@ -621,7 +756,7 @@ void Resources::createInstanceData() {
     std::uniform_real_distribution<float> uniformDist(-50, 50);
     int yIndex{};
     int xIndex{};
-    for (int index{0}; index < 500; index++) {
+    for (uint32_t index{0}; index < m_renderer.instanceCount; index++) {
         glm::vec3 instance{};
         if (index % 10 == 0) {
             yIndex++;
@@ -642,6 +777,14 @@ void Resources::createInstanceData() {
         size);
 }
 
+void Resources::createVisibleInstanceBuffers() {
+    // sized for every instance so a frame where nothing is culled still fits
+    vk::DeviceSize size{sizeof(glm::vec3) * std::max<size_t>(instances.size(), 1)};
+    for (auto& frame : frames) {
+        frame.visibleInstanceBuffer = createBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst, size, 0, VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.visibleInstanceAlloc, MemoryTelemetry::Category::Geometry);
+    }
+}
+
 void Resources::loadModel(const std::string& name, std::vector<Resources::Vertex>& vertices, std::vector<std::uint32_t>& indices, bool customUV) {
     Assimp::Importer importer{};
     const aiScene* scene{nullptr};
@@ -684,34 +827,14 @@ void Resources::loadModel(const std::string& name, std::vector<Resources::Vertex
     }
 }
 
-void Resources::createVertexBuffer(const VmaAllocator& allocator, vk::raii::Buffer& buffer, vk::BufferUsageFlags usage, VmaAllocation& alloc, void* src, vk::DeviceSize size) {
-    vk::raii::Buffer stagingBuffer{nullptr};
-    VmaAllocation allocation{nullptr};
-    stagingBuffer = createBuffer(vk::BufferUsageFlagBits::eTransferSrc, size, VmaAllocationCreateFlagBits::VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, 0, allocation);
-    mapMemory(m_renderer.allocator, allocation, src, size);
-    buffer = createBuffer(usage, size, 0, VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, alloc);
-    
-    auto cb = createSingleTimeCB();
-    vk::CommandBufferBeginInfo beginInfo{};
-    beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-    cb.begin(beginInfo);
-    copyBuffer(cb, *stagingBuffer, *buffer, size);
-    cb.end();
-
-    vk::SubmitInfo submitInfo{};
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &*cb;
-    m_renderer.m_queue.submit(submitInfo);
-    m_renderer.m_queue.waitIdle();
-    cb.clear();
-    stagingBuffer.clear();
-    vmaFreeMemory(allocator, allocation);
-    return;
+void Resources::createVertexBuffer(const VmaAllocator& allocator, vk::raii::Buffer& buffer, vk::BufferUsageFlags usage, VmaAllocation& alloc, const void* src, vk::DeviceSize size) {
+    buffer = createBuffer(usage, size, 0, VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, alloc, MemoryTelemetry::Category::Geometry);
+    getUploadBatch().copyToBuffer(src, size, *buffer);
 }
 
-void Resources::copyBufferToImage(const vk::raii::CommandBuffer& commandBuffer, const vk::raii::Buffer& buffer, const vk::Image& image, uint32_t width, uint32_t height) {
+void Resources::copyBufferToImage(const vk::raii::CommandBuffer& commandBuffer, const vk::Buffer& buffer, vk::DeviceSize bufferOffset, const vk::Image& image, uint32_t width, uint32_t height) {
     vk::BufferImageCopy region{};
-    region.bufferOffset = 0;
+    region.bufferOffset = bufferOffset;
     region.bufferRowLength = 0;
     region.bufferImageHeight = 0;
 
@@ -726,22 +849,112 @@ void Resources::copyBufferToImage(const vk::raii::CommandBuffer& commandBuffer,
         height,
         1};
 
-    commandBuffer.copyBufferToImage(*buffer, image, vk::ImageLayout::eTransferDstOptimal, region);
+    commandBuffer.copyBufferToImage(buffer, image, vk::ImageLayout::eTransferDstOptimal, region);
     
 }
 
 void Resources::createMesh(const std::string& Modelname, const std::string& textureName, Mesh& mesh, bool customUV) {
-    std::vector<Resources::Vertex> vertices{};
-    std::vector<std::uint32_t> indices{};
-    loadModel(Modelname, vertices, indices, customUV);
-    vk::DeviceSize vertexSize{sizeof(vertices[0]) * vertices.size()};
-    createVertexBuffer(m_renderer.allocator, mesh.vertexBuffer, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst, mesh.vertexAlloc, vertices.data(), vertexSize);
-    vk::DeviceSize indexSize{sizeof(indices[0]) * indices.size()};
-    createVertexBuffer(m_renderer.allocator, mesh.indexBuffer, vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst, mesh.indexAlloc, indices.data(), indexSize);
-    mesh.verticesCount = vertices.size();
-    mesh.indicesCount = indices.size();
+    createMesh(decodeModel(Modelname, customUV), decodeImage(textureName), mesh);
+}
+
+void Resources::createMesh(const ModelData& model, const ImageData& texture, Mesh& mesh, bool compact) {
+    PROFILE_ZONE("createMesh");
+    if (model.stats)
+        std::cout << model.name << ": " << model.stats->verticesBefore << " -> " << model.stats->verticesAfter << " vertices, acmr "
+                  << model.stats->acmrBefore << " -> " << model.stats->acmrAfter << "\n";
+    const auto& vertices = model.vertices;
+    if (compact) {
+        auto compactVertices = quantizeVertices(vertices, mesh.positionScale, mesh.positionOffset);
+        uploadVertices(compactVertices.data(), sizeof(compactVertices[0]), compactVertices.size(), mesh);
+    } else {
+        uploadVertices(vertices.data(), sizeof(vertices[0]), vertices.size(), mesh);
+    }
+    mesh.compact = compact;
+    mesh.boundingSphere = getBoundingSphere(vertices);
+    uploadIndices(model.indices, vertices.size(), mesh);
 
-    loadImage(textureName, mesh.image, mesh.imageView, mesh.imageAlloc, mesh.sampler);
+    loadImage(texture, mesh.image, mesh.imageView, mesh.imageAlloc, mesh.sampler);
+    mesh.textureIndex = textureTable->registerTexture(*mesh.imageView, *mesh.sampler);
+}
+
+void Resources::createTextureTable() {
+    textureTable = std::make_unique<TextureTable>(m_renderer);
+}
+
+void Resources::createGeometryHeap() {
+    const vk::DeviceSize vertexCapacity{64 * 1024 * 1024};
+    const vk::DeviceSize indexCapacity{16 * 1024 * 1024};
+    geometryHeap = std::make_unique<GeometryHeap>(m_renderer, vertexCapacity, indexCapacity);
+}
+
+void Resources::uploadVertices(const void* src, vk::DeviceSize stride, size_t vertexCount, Mesh& mesh) {
+    // aligning to the stride keeps the offset a whole number of vertices
+    mesh.geometryHeap = geometryHeap.get();
+    mesh.vertexRange = geometryHeap->allocateVertices(src, stride * vertexCount, stride);
+    mesh.vertexOffset = static_cast<std::int32_t>(mesh.vertexRange.offset / stride);
+    mesh.verticesCount = vertexCount;
+}
+
+void Resources::uploadIndices(const std::vector<std::uint32_t>& indices, size_t vertexCount, Mesh& mesh) {
+    mesh.geometryHeap = geometryHeap.get();
+    mesh.indicesCount = static_cast<std::uint32_t>(indices.size());
+    if (vertexCount > std::numeric_limits<std::uint16_t>::max() + size_t{1}) {
+        mesh.indexType = vk::IndexType::eUint32;
+        mesh.indexRange = geometryHeap->allocateIndices(indices.data(), sizeof(indices[0]) * indices.size(), sizeof(indices[0]));
+        mesh.firstIndex = static_cast<std::uint32_t>(mesh.indexRange.offset / sizeof(indices[0]));
+        return;
+    }
+
+    // every index fits so the range is half the size
+    std::vector<std::uint16_t> shortIndices(indices.begin(), indices.end());
+    mesh.indexType = vk::IndexType::eUint16;
+    mesh.indexRange = geometryHeap->allocateIndices(shortIndices.data(), sizeof(shortIndices[0]) * shortIndices.size(), sizeof(shortIndices[0]));
+    mesh.firstIndex = static_cast<std::uint32_t>(mesh.indexRange.offset / sizeof(shortIndices[0]));
+}
+
+glm::vec4 Resources::getBoundingSphere(const std::vector<Vertex>& vertices) {
+    if (vertices.empty())
+        return glm::vec4{0.0f};
+    // centered on the bounding box, not the tightest sphere but close enough to cull with
+    glm::vec3 minimum{vertices[0].pos};
+    glm::vec3 maximum{vertices[0].pos};
+    for (const auto& vertex : vertices) {
+        minimum = glm::min(minimum, vertex.pos);
+        maximum = glm::max(maximum, vertex.pos);
+    }
+    glm::vec3 center{(minimum + maximum) * 0.5f};
+    float radius{};
+    for (const auto& vertex : vertices)
+        radius = std::max(radius, glm::length(vertex.pos - center));
+    return glm::vec4{center, radius};
+}
+
+std::vector<Resources::CompactVertex> Resources::quantizeVertices(const std::vector<Vertex>& vertices, glm::vec4& positionScale, glm::vec4& positionOffset) {
+    glm::vec3 minimum{std::numeric_limits<float>::max()};
+    glm::vec3 maximum{std::numeric_limits<float>::lowest()};
+    for (const auto& vertex : vertices) {
+        minimum = glm::min(minimum, vertex.pos);
+        maximum = glm::max(maximum, vertex.pos);
+    }
+    // the bounds are mapped onto [-1, 1] per axis, a flat axis keeps a scale of 1
+    glm::vec3 center{(minimum + maximum) * 0.5f};
+    glm::vec3 extent{(maximum - minimum) * 0.5f};
+    for (int axis{}; axis < 3; axis++) {
+        if (extent[axis] <= 0.0f)
+            extent[axis] = 1.0f;
+    }
+    positionScale = glm::vec4{extent, 1.0f};
+    positionOffset = glm::vec4{center, 0.0f};
+
+    std::vector<CompactVertex> compactVertices(vertices.size());
+    for (size_t index{}; index < vertices.size(); index++) {
+        glm::vec3 normalized{glm::clamp((vertices[index].pos - center) / extent, -1.0f, 1.0f)};
+        for (int axis{}; axis < 3; axis++)
+            compactVertices[index].pos[axis] = static_cast<std::int16_t>(std::lround(normalized[axis] * 32767.0f));
+        compactVertices[index].texCoord[0] = static_cast<std::uint16_t>(glm::packHalf1x16(vertices[index].texCoord.x));
+        compactVertices[index].texCoord[1] = static_cast<std::uint16_t>(glm::packHalf1x16(vertices[index].texCoord.y));
+    }
+    return compactVertices;
 }
 
 void Resources::copyBuffer(vk::raii::CommandBuffer& cb, const vk::Buffer& srcBuffer, const vk::Buffer& dstBuffer, vk::DeviceSize size) {
@@ -754,17 +967,53 @@ void Resources::copyBuffer(vk::raii::CommandBuffer& cb, const vk::Buffer& srcBuf
     return;
 }
 
-Resources::Mesh::Mesh(const VmaAllocator& allocator)
-    : allocator{allocator}{
+UploadBatch& Resources::getUploadBatch() {
+    if (!uploadBatch)
+        uploadBatch = std::make_unique<UploadBatch>(m_renderer, stagingRing.get());
+    return *uploadBatch;
+}
+
+void Resources::submitUploads() {
+    if (!uploadBatch)
+        return;
+    uploadBatch->submit();
+    pendingUploads.push_back(std::move(uploadBatch));
+}
+
+void Resources::collectUploads() {
+    PROFILE_ZONE("collectUploads");
+    // anything recorded since the last frame goes out before the frame itself
+    // so the queue order makes it visible to the draws
+    submitUploads();
+    std::erase_if(pendingUploads, [](std::unique_ptr<UploadBatch>& uploads) {
+        return uploads->isComplete();
+    });
+    if (stagingRing)
+        stagingRing->reclaim();
+}
+
+void Resources::createStagingRing() {
+    // startup uploads are a one off and get their own chunks, the ring only
+    // has to cover what gets streamed in while frames are running
+    vk::DeviceSize ringSize{64 * 1024 * 1024};
+    // cpu culling streams every frame's visible instances through the ring, one
+    // frame more than can be in flight keeps it from waiting on the gpu
+    if (m_renderer.pCpuCulling)
+        ringSize = std::max<vk::DeviceSize>(ringSize, (sizeof(glm::vec3) * instances.size() + 16) * (frames.size() + 1) + 16);
+    stagingRing = std::make_unique<StagingRing>(m_renderer, ringSize);
+}
+
+Resources::Mesh::Mesh(MemoryTelemetry& memory)
+    : memory{memory}{
 }
 
 Resources::Mesh::~Mesh() {
-    vertexBuffer.clear();
-    indexBuffer.clear();
-    vmaFreeMemory(allocator, vertexAlloc);
-    vmaFreeMemory(allocator, indexAlloc);
+    if (geometryHeap) {
+        geometryHeap->freeVertices(vertexRange);
+        geometryHeap->freeIndices(indexRange);
+    }
     sampler.clear();
     imageView.clear();
     image.clear();
-    vmaFreeMemory(allocator, imageAlloc);
+    memory.free(imageAlloc);
 }
@@ -1,6 +1,13 @@
 #pragma once
 #include "commonIncludes.h"
 #include "vma/vk_mem_alloc.h"
+#include "UploadBatch.h"
+#include "CompressedTexture.h"
+#include "GeometryHeap.h"
+#include "TextureTable.h"
+#include "FrameAllocator.h"
+#include "MemoryTelemetry.h"
+#include <optional>
 class Renderer;
 class Resources {
   private:
@@ -8,24 +15,35 @@ class Resources {
     void createCommandPools();
     void createCommandbuffer();
     void createSyncObjects();
-    void createBuffers(vk::raii::Buffer& buffer, vk::raii::DeviceMemory& memory, vk::DeviceSize size, vk::BufferUsageFlagBits usage);
-    void mapMemory(vk::raii::DeviceMemory& memory, vk::DeviceSize size, const auto& vec);
   public:
       class Mesh {
       public:
-       Mesh(const VmaAllocator& allocator);
+       Mesh(MemoryTelemetry& memory);
        ~Mesh();
-        const VmaAllocator& allocator;
-        vk::raii::Buffer vertexBuffer{nullptr};
-        VmaAllocation vertexAlloc{nullptr};
+        MemoryTelemetry& memory;
+        // the geometry lives in the shared heap, vertexOffset and firstIndex
+        // are in vertices and indices of this mesh's own stride and index type
+        GeometryHeap* geometryHeap{nullptr};
+        GeometryHeap::Range vertexRange{};
+        GeometryHeap::Range indexRange{};
+        std::int32_t vertexOffset{};
+        std::uint32_t firstIndex{};
         std::size_t verticesCount{};
-        vk::raii::Buffer indexBuffer{nullptr};
-        VmaAllocation indexAlloc{nullptr};
         std::uint32_t indicesCount{};
+        vk::IndexType indexType{vk::IndexType::eUint32};
+        // compact meshes store positions as snorm16 relative to their bounds,
+        // the vertex shader undoes it with pos * positionScale + positionOffset
+        bool compact{false};
+        glm::vec4 positionScale{1.0f};
+        glm::vec4 positionOffset{0.0f};
+        // model space, xyz is the center and w the radius
+        glm::vec4 boundingSphere{};
         vk::raii::Image image{nullptr};
         VmaAllocation imageAlloc{nullptr};
         vk::raii::ImageView imageView{nullptr};
         vk::raii::Sampler sampler{nullptr};
+        // slot of the texture in the texture table
+        std::uint32_t textureIndex{};
     };
 
       struct Vertex {
@@ -34,50 +52,97 @@ class Resources {
           glm::vec2 texCoord{};
       };
 
+      // 12 byte layout for opt-in compact meshes, the color is always white
+      // so it is dropped and the texture coordinates are half floats
+      struct CompactVertex {
+          std::array<std::int16_t, 4> pos{};
+          std::array<std::uint16_t, 2> texCoord{};
+      };
+
+      // cpu side results of decoding a file, these are produced on the
+      // thread pool and only turned into gpu resources afterwards
+      struct ImageData {
+          struct PixelDeleter {
+              void operator()(unsigned char* pixels) const;
+          };
+          int width{};
+          int height{};
+          std::unique_ptr<unsigned char, PixelDeleter> pixels{};
+          // set instead of pixels when the texture came from a ktx2 or dds file
+          std::unique_ptr<CompressedTexture> compressed{};
+          vk::DeviceSize getSize() const;
+      };
+
+      // what MeshOptimizer did to a model
+      struct MeshStats {
+          size_t verticesBefore{};
+          size_t verticesAfter{};
+          // average cache miss ratio, transformed vertices per triangle
+          float acmrBefore{};
+          float acmrAfter{};
+      };
+
+      struct ModelData {
+          std::vector<Vertex> vertices{};
+          std::vector<std::uint32_t> indices{};
+          // only set when the model was optimized instead of read from the mesh cache,
+          // decoding runs on the thread pool so createMesh prints them
+          std::string name{};
+          std::optional<MeshStats> stats{};
+      };
+
+      // everything the cpu touches while recording a frame lives here so
+      // frame N+1 can be recorded while the gpu is still busy with frame N
+      struct Frame {
+          vk::raii::CommandBuffer commandBuffer{nullptr};
+          vk::raii::Semaphore imageAvailableSemaphore{nullptr};
+          vk::raii::Semaphore finishedRenderingSemaphore{nullptr};
+          vk::raii::Fence inFlightFence{nullptr};
+          vk::raii::DescriptorSet descriptorSet{nullptr};
+          vk::raii::DescriptorSet skyDescriptorSet{nullptr};
+          // the instances that survived cpu culling, rewritten every frame
+          vk::raii::Buffer visibleInstanceBuffer{nullptr};
+          VmaAllocation visibleInstanceAlloc{nullptr};
+          // bumped on every submit so readbacks can tell which submission finished
+          uint64_t submitCount{};
+      };
+
     std::vector<vk::raii::Framebuffer> frambebuffers;
     vk::raii::CommandPool commandPool{nullptr};
-    vk::raii::CommandBuffers commandBuffer{nullptr};
-    vk::raii::Semaphore imageAvailableSemaphores{nullptr};
-    vk::raii::Semaphore finishedRenderingSemaphores{nullptr};
-    vk::raii::Fence inFlightFences{nullptr};
-    vk::raii::Fence screenCaptureFence{nullptr};
-    vk::raii::Buffer vertexBuffer{nullptr};
-    vk::raii::DeviceMemory vertexBufferMemory{nullptr};
-    vk::raii::Buffer indexBuffer{nullptr};
-    vk::raii::DeviceMemory indexBufferMemory{nullptr};
-    vk::raii::Buffer uniformBuffer{nullptr};
-    vk::raii::Buffer uniformBuffer2{nullptr};
-    vk::raii::DeviceMemory uniformBufferMemory{nullptr};
-    vk::raii::DeviceMemory uniformBufferMemory2{nullptr};
+    std::vector<Frame> frames{};
+    // the batch new uploads are recorded into and the submitted ones whose
+    // staging memory is still waiting on their fence
+    std::unique_ptr<StagingRing> stagingRing{};
+    std::unique_ptr<UploadBatch> uploadBatch{};
+    std::vector<std::unique_ptr<UploadBatch>> pendingUploads{};
+    // transient per frame constants, bound with dynamic offsets
+    std::unique_ptr<FrameAllocator> frameAllocator{};
+    // declared before the meshes so it outlives the ranges they give back
+    std::unique_ptr<GeometryHeap> geometryHeap{};
     vk::raii::DescriptorPool descriptorPool{nullptr};
-    std::vector<vk::raii::DescriptorSet> descriptorSet{};
     vk::Buffer textureBuffer{};
     vk::raii::Framebuffer blitFramebuffer{nullptr};
     Mesh cube;
     Mesh viking;
     Mesh atlasCube;
-    VmaAllocation depthAlloc{nullptr};
-    vk::raii::Image depthImage{nullptr};
-    vk::raii::ImageView depthImageView{nullptr};
     vk::raii::Image texImage3{nullptr};
     VmaAllocation texImageAlloc3{nullptr};
     vk::raii::ImageView texImageView3{nullptr};
     vk::raii::Sampler texSampler3{nullptr};
-    std::vector<vk::raii::DescriptorSet> skyDescriptorSet{};
+    std::uint32_t texImage3Index{};
+    // every texture the scene samples, bound once as set 1 of the graphics pipeline
+    std::unique_ptr<TextureTable> textureTable{};
     vk::raii::DescriptorSet computeDescriptorSet{nullptr};
     vk::raii::Image skyBoxImage{nullptr};
     VmaAllocation skyBoxImageAlloc{nullptr};
     vk::raii::ImageView skyBoxImageView{nullptr};
     vk::raii::Sampler skyBoxSampler{nullptr};
     void* colorPtr{nullptr};
-    void* uboPtr{nullptr};
-    void* uboPtr2{nullptr};
     std::vector<glm::vec3> instances{};
     vk::raii::Buffer instanceBuffer{nullptr};
     VmaAllocation instanceAlloc{nullptr};
 
     Resources(Renderer& renderer);
-    uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties);
     void createframebuffers();
     void createBlitFrameBuffer();
     ~Resources();
@@ -86,20 +151,47 @@ class Resources {
     void allocateDescriptorSets();
     void allocateSkyDescriptorSet();
     void allocateComputeDescSet();
-    vk::raii::Buffer createBuffer(vk::BufferUsageFlags usage, vk::DeviceSize size, VmaAllocationCreateFlags createFlags, VkMemoryPropertyFlags propertyFlags, VmaAllocation& allocation);
+    vk::raii::Buffer createBuffer(vk::BufferUsageFlags usage, vk::DeviceSize size, VmaAllocationCreateFlags createFlags, VkMemoryPropertyFlags propertyFlags, VmaAllocation& allocation, MemoryTelemetry::Category category);
     void mapMemory(const VmaAllocator& allocator, const VmaAllocation& allocation, void* src, VkDeviceSize size);
     void* mapPersistentMemory(const VmaAllocator& allocator, const VmaAllocation& allocation, VkDeviceSize size);
     void loadImage(const std::string& imageName, vk::raii::Image& image, vk::raii::ImageView& imageView, VmaAllocation& imageAlloc, vk::raii::Sampler& sampler);
-    vk::raii::Image createImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, VmaAllocationCreateFlags createFlags, VkMemoryPropertyFlags propertyFlags, const VmaAllocator& allocator, VmaAllocation& allocation);
+    void loadImage(const ImageData& imageData, vk::raii::Image& image, vk::raii::ImageView& imageView, VmaAllocation& imageAlloc, vk::raii::Sampler& sampler);
+    // the decode functions only touch their arguments so they are safe to run on any thread
+    static ImageData decodeImage(const std::string& imageName);
+    // prefers a pre-compressed .ktx2 or .dds next to the image over decoding it
+    static ImageData decodeTexture(const std::string& imageName);
+    ModelData decodeModel(const std::string& name, bool customUV = false);
+    vk::raii::Image createImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, VmaAllocationCreateFlags createFlags, VkMemoryPropertyFlags propertyFlags, const VmaAllocator& allocator, VmaAllocation& allocation, MemoryTelemetry::Category category, uint32_t mipLevels = 1);
     vk::raii::CommandBuffer createSingleTimeCB();
-    vk::raii::ImageView createImageView(const vk::Image& image, vk::Format format, vk::ImageAspectFlags aspectFlags);
-    vk::raii::Sampler createSampler();
-    void createDepthBuffer();
+    vk::raii::ImageView createImageView(const vk::Image& image, vk::Format format, vk::ImageAspectFlags aspectFlags, uint32_t mipLevels = 1);
+    vk::raii::Sampler createSampler(uint32_t mipLevels = 1);
     void loadModel(const std::string& name, std::vector<Resources::Vertex>& vertices, std::vector<std::uint32_t>& indices, bool customUV = false);
-    void createVertexBuffer(const VmaAllocator& allocator, vk::raii::Buffer& buffer, vk::BufferUsageFlags usage, VmaAllocation& alloc, void* src, vk::DeviceSize size);
-    void copyBufferToImage(const vk::raii::CommandBuffer& commandBuffer, const vk::raii::Buffer& buffer, const vk::Image& image, uint32_t width, uint32_t height);
+    void createVertexBuffer(const VmaAllocator& allocator, vk::raii::Buffer& buffer, vk::BufferUsageFlags usage, VmaAllocation& alloc, const void* src, vk::DeviceSize size);
+    void copyBufferToImage(const vk::raii::CommandBuffer& commandBuffer, const vk::Buffer& buffer, vk::DeviceSize bufferOffset, const vk::Image& image, uint32_t width, uint32_t height);
     void createMesh(const std::string& Modelname, const std::string& textureName, Mesh& mesh, bool customUV = false);
+    void createMesh(const ModelData& model, const ImageData& texture, Mesh& mesh, bool compact = false);
+    void createGeometryHeap();
+    void createTextureTable();
+    void uploadVertices(const void* src, vk::DeviceSize stride, size_t vertexCount, Mesh& mesh);
+    void uploadIndices(const std::vector<std::uint32_t>& indices, size_t vertexCount, Mesh& mesh);
+    static glm::vec4 getBoundingSphere(const std::vector<Vertex>& vertices);
+    static std::vector<CompactVertex> quantizeVertices(const std::vector<Vertex>& vertices, glm::vec4& positionScale, glm::vec4& positionOffset);
     void copyBuffer(vk::raii::CommandBuffer& cb, const vk::Buffer& srcBuffer, const vk::Buffer& dstBuffer, vk::DeviceSize size);
     void createSkyBox();
+    void createSkyBox(const std::vector<ImageData>& faceImages);
+    static uint32_t getMipLevels(int width, int height);
+    bool supportsLinearBlit(vk::Format format);
+    bool supportsCompressedFormat(vk::Format format);
+    void loadCompressedImage(const CompressedTexture& texture, vk::raii::Image& image, vk::raii::ImageView& imageView, VmaAllocation& imageAlloc, vk::raii::Sampler& sampler);
+    // uploads level 0 of every layer and fills in the rest of the chain, all
+    // levels end up in eShaderReadOnlyOptimal
+    void uploadTexture(UploadBatch& uploads, const std::vector<const ImageData*>& layers, const vk::Image& image, vk::Format format, uint32_t mipLevels, bool isCubeMap = false);
+    void generateMipmaps(vk::raii::CommandBuffer& commandBuffer, const vk::Image& image, int width, int height, uint32_t mipLevels, uint32_t layerCount);
+    static std::vector<unsigned char> generateMipChain(const ImageData& imageData, uint32_t mipLevels, std::vector<vk::DeviceSize>& levelOffsets);
     void createInstanceData();
+    void createVisibleInstanceBuffers();
+    UploadBatch& getUploadBatch();
+    void submitUploads();
+    void collectUploads();
+    void createStagingRing();
 };
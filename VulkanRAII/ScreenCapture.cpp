@@ -0,0 +1,162 @@
+#include "ScreenCapture.h"
+#include "PresentationEngine.h"
+#include "Renderer.h"
+#include "Resources.h"
+#include <stb_image_write.h>
+
+ScreenCapture::ScreenCapture(Renderer& renderer)
+    : m_renderer{renderer} {
+    worker = std::thread{&ScreenCapture::encodeLoop, this};
+}
+
+ScreenCapture::~ScreenCapture() {
+    {
+        std::lock_guard lock{queueMutex};
+        stopWorker = true;
+    }
+    queueCondition.notify_all();
+    if (worker.joinable())
+        worker.join();
+
+    for (auto& slot : slots)
+        destroySlotBuffer(slot);
+}
+
+void ScreenCapture::createSlotBuffer(Slot& slot, vk::DeviceSize size) {
+    destroySlotBuffer(slot);
+    slot.buffer = m_renderer.pResources->createBuffer(vk::BufferUsageFlagBits::eTransferDst, size, VmaAllocationCreateFlagBits::VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT, 0, slot.allocation, MemoryTelemetry::Category::Staging);
+    slot.mappedPtr = m_renderer.pResources->mapPersistentMemory(m_renderer.allocator, slot.allocation, size);
+    slot.size = size;
+}
+
+void ScreenCapture::destroySlotBuffer(Slot& slot) {
+    if (!slot.allocation)
+        return;
+    slot.buffer.clear();
+    vmaUnmapMemory(m_renderer.allocator, slot.allocation);
+    m_renderer.memoryTelemetry.free(slot.allocation);
+    slot.allocation = nullptr;
+    slot.mappedPtr = nullptr;
+    slot.size = 0;
+}
+
+bool ScreenCapture::recordCapture(vk::raii::CommandBuffer& commandBuffer, uint32_t frameIndex, vk::Image source) {
+    auto freeSlot = std::find_if(slots.begin(), slots.end(), [](const Slot& slot) {
+        return slot.state == SlotState::Free;
+    });
+    if (freeSlot == slots.end()) {
+        droppedCaptures++;
+        return false;
+    }
+    auto& slot = *freeSlot;
+
+    vk::Extent2D extent{m_renderer.pEngine->swapChainExtent};
+    vk::DeviceSize size = static_cast<vk::DeviceSize>(extent.width) * extent.height * 4;
+    // the buffers only grow, a smaller swapchain just uses part of them
+    if (slot.size < size)
+        createSlotBuffer(slot, size);
+
+    vk::BufferImageCopy bufferCopy{};
+    bufferCopy.bufferRowLength = 0;
+    bufferCopy.bufferOffset = 0;
+    bufferCopy.bufferImageHeight = 0;
+    bufferCopy.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+    bufferCopy.imageSubresource.mipLevel = 0;
+    bufferCopy.imageSubresource.baseArrayLayer = 0;
+    bufferCopy.imageSubresource.layerCount = 1;
+    bufferCopy.imageOffset = vk::Offset3D{0, 0, 0};
+    bufferCopy.imageExtent = vk::Extent3D{extent.width, extent.height, 1};
+
+    vk::MemoryBarrier barrier{};
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+    commandBuffer.copyImageToBuffer(source, vk::ImageLayout::eTransferSrcOptimal, *slot.buffer, bufferCopy);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, barrier, nullptr, nullptr);
+
+    slot.extent = extent;
+    slot.frameIndex = frameIndex;
+    // the copy belongs to the submission that is about to happen for this frame
+    slot.submitCount = m_renderer.pResources->frames[frameIndex].submitCount + 1;
+    slot.captureIndex = captureCount++;
+    slot.state = SlotState::InFlight;
+    return true;
+}
+
+vk::Format ScreenCapture::getCaptureFormat(vk::Format format) {
+    bool srgb{format == vk::Format::eB8G8R8A8Srgb || format == vk::Format::eR8G8B8A8Srgb || format == vk::Format::eA8B8G8R8SrgbPack32};
+    return srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm;
+}
+
+void ScreenCapture::poll() {
+    for (uint32_t index{}; index < slotCount; index++) {
+        auto& slot = slots[index];
+        if (slot.state != SlotState::InFlight)
+            continue;
+
+        // once the frame has been submitted again its fence was already waited on,
+        // otherwise the fence still belongs to the submission holding our copy
+        const auto& frame = m_renderer.pResources->frames[slot.frameIndex];
+        bool finished{frame.submitCount > slot.submitCount};
+        if (!finished && frame.submitCount == slot.submitCount)
+            finished = m_renderer.m_device.getFenceStatus(*frame.inFlightFence) == vk::Result::eSuccess;
+        if (!finished)
+            continue;
+
+        vmaInvalidateAllocation(m_renderer.allocator, slot.allocation, 0, slot.size);
+        slot.state = SlotState::Encoding;
+        {
+            std::lock_guard lock{queueMutex};
+            pendingSlots.push_back(index);
+        }
+        queueCondition.notify_one();
+    }
+}
+
+void ScreenCapture::flush() {
+    m_renderer.m_device.waitIdle();
+    poll();
+
+    std::unique_lock lock{queueMutex};
+    idleCondition.wait(lock, [this] {
+        return pendingSlots.empty() && std::none_of(slots.begin(), slots.end(), [](const Slot& slot) {
+            return slot.state == SlotState::Encoding;
+        });
+    });
+}
+
+uint64_t ScreenCapture::getDroppedCaptures() const {
+    return droppedCaptures;
+}
+
+void ScreenCapture::encodeLoop() {
+    while (true) {
+        uint32_t index{};
+        {
+            std::unique_lock lock{queueMutex};
+            queueCondition.wait(lock, [this] { return stopWorker || !pendingSlots.empty(); });
+            // the queue is drained before the worker is allowed to stop
+            if (pendingSlots.empty())
+                return;
+            index = pendingSlots.front();
+            pendingSlots.pop_front();
+        }
+
+        encodeSlot(slots[index]);
+        {
+            std::lock_guard lock{queueMutex};
+            slots[index].state = SlotState::Free;
+        }
+        idleCondition.notify_all();
+    }
+}
+
+void ScreenCapture::encodeSlot(Slot& slot) {
+    // copy out of the mapped memory first, it might be uncached
+    vk::DeviceSize size = static_cast<vk::DeviceSize>(slot.extent.width) * slot.extent.height * 4;
+    std::vector<stbi_uc> pixels(size);
+    std::memcpy(pixels.data(), slot.mappedPtr, size);
+
+    std::string fileName{"screenshot_" + std::to_string(slot.captureIndex) + ".png"};
+    if (!stbi_write_png(fileName.c_str(), slot.extent.width, slot.extent.height, STBI_rgb_alpha, pixels.data(), slot.extent.width * 4))
+        std::cerr << "failed to write " << fileName << '\n';
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "commonIncludes.h"
+#include "vma/vk_mem_alloc.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+class Renderer;
+// captures an rgba image into a ring of persistently mapped readback buffers,
+// the copy is recorded into the frames own command buffer and the png encoding
+// happens on a worker thread so capturing never stalls the render loop
+class ScreenCapture {
+  private:
+    enum class SlotState {
+        Free,
+        InFlight,
+        Encoding
+    };
+
+    struct Slot {
+        vk::raii::Buffer buffer{nullptr};
+        VmaAllocation allocation{nullptr};
+        void* mappedPtr{nullptr};
+        vk::DeviceSize size{};
+        vk::Extent2D extent{};
+        uint32_t frameIndex{};
+        uint64_t submitCount{};
+        uint64_t captureIndex{};
+        std::atomic<SlotState> state{SlotState::Free};
+    };
+
+    static constexpr uint32_t slotCount{8};
+
+    Renderer& m_renderer;
+    std::array<Slot, slotCount> slots{};
+    uint64_t captureCount{};
+    uint64_t droppedCaptures{};
+
+    std::thread worker{};
+    std::mutex queueMutex{};
+    std::condition_variable queueCondition{};
+    std::condition_variable idleCondition{};
+    std::deque<uint32_t> pendingSlots{};
+    bool stopWorker{false};
+
+    void createSlotBuffer(Slot& slot, vk::DeviceSize size);
+    void destroySlotBuffer(Slot& slot);
+    void encodeLoop();
+    void encodeSlot(Slot& slot);
+
+  public:
+    ScreenCapture(Renderer& renderer);
+    ~ScreenCapture();
+    // records a copy of source, which has to be a swapchain sized image in
+    // getCaptureFormat and eTransferSrcOptimal, returns false if every readback
+    // buffer is still busy and the frame was dropped
+    bool recordCapture(vk::raii::CommandBuffer& commandBuffer, uint32_t frameIndex, vk::Image source);
+    // the rgba format a frame in format is blitted to before the copy, an srgb
+    // frame stays srgb so the bytes come out unchanged
+    static vk::Format getCaptureFormat(vk::Format format);
+    // hands every copy the gpu has finished to the worker without waiting on anything
+    void poll();
+    // waits until the gpu and the worker are done with every outstanding capture
+    void flush();
+    uint64_t getDroppedCaptures() const;
+};
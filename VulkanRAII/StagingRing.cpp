@@ -0,0 +1,145 @@
+#include "StagingRing.h"
+#include "Renderer.h"
+#include "Resources.h"
+
+StagingRing::StagingRing(Renderer& renderer, vk::DeviceSize capacity)
+    : m_renderer{renderer}
+    , capacity{capacity} {
+    buffer = m_renderer.pResources->createBuffer(vk::BufferUsageFlagBits::eTransferSrc, capacity, VmaAllocationCreateFlagBits::VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, 0, allocation, MemoryTelemetry::Category::Staging);
+    mappedPtr = m_renderer.pResources->mapPersistentMemory(m_renderer.allocator, allocation, capacity);
+    stats.capacity = capacity;
+}
+
+StagingRing::~StagingRing() {
+    buffer.clear();
+    vmaUnmapMemory(m_renderer.allocator, allocation);
+    m_renderer.memoryTelemetry.free(allocation);
+}
+
+bool StagingRing::allocate(vk::DeviceSize size, vk::DeviceSize alignment, Allocation& allocation) {
+    // a request has to leave at least one byte free so a full ring never looks empty
+    if (size + alignment >= capacity) {
+        stats.failures++;
+        return false;
+    }
+
+    reclaim();
+    vk::DeviceSize offset{};
+    while (!tryAllocate(size, alignment, offset)) {
+        // only allocations that were never submitted are left, waiting cannot help
+        if (regions.empty() || !waitForOldestRegion()) {
+            stats.failures++;
+            return false;
+        }
+        stats.stalls++;
+        reclaim();
+    }
+
+    allocation.buffer = *buffer;
+    allocation.offset = offset;
+    allocation.ptr = static_cast<char*>(mappedPtr) + offset;
+    stats.allocations++;
+    stats.used = getUsed();
+    stats.peakUsed = std::max(stats.peakUsed, stats.used);
+    return true;
+}
+
+bool StagingRing::tryAllocate(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset) {
+    vk::DeviceSize aligned{(head + alignment - 1) / alignment * alignment};
+    if (head >= tail) {
+        // the free space is [head, capacity) followed by [0, tail)
+        if (aligned + size <= capacity) {
+            offset = aligned;
+            head = aligned + size;
+            return true;
+        }
+        // the end of the ring is skipped and comes back once the tail passes it
+        if (size < tail) {
+            offset = 0;
+            head = size;
+            stats.wraps++;
+            return true;
+        }
+        return false;
+    }
+
+    // the free space is [head, tail)
+    if (aligned + size < tail) {
+        offset = aligned;
+        head = aligned + size;
+        return true;
+    }
+    return false;
+}
+
+void StagingRing::flush(vk::DeviceSize offset, vk::DeviceSize size) {
+    if (vmaFlushAllocation(m_renderer.allocator, allocation, offset, size) != VK_SUCCESS)
+        throw std::runtime_error("vma flush failed");
+}
+
+void StagingRing::closeFrame(uint32_t frameIndex) {
+    if (head == closedHead)
+        return;
+
+    Region region{};
+    region.end = head;
+    region.frameIndex = frameIndex;
+    region.submitCount = m_renderer.pResources->frames[frameIndex].submitCount + 1;
+    regions.push_back(region);
+    closedHead = head;
+}
+
+void StagingRing::reclaim() {
+    while (!regions.empty() && isRegionFinished(regions.front())) {
+        tail = regions.front().end;
+        regions.pop_front();
+    }
+    // an empty ring starts over at the front so big requests don't have to wrap
+    if (regions.empty() && head == closedHead && head == tail) {
+        head = 0;
+        tail = 0;
+        closedHead = 0;
+    }
+    stats.used = getUsed();
+}
+
+bool StagingRing::isRegionFinished(const Region& region) {
+    // same rule as the screen capture readbacks, a newer submit of the frame
+    // means its fence was already waited on
+    const auto& frame = m_renderer.pResources->frames[region.frameIndex];
+    if (frame.submitCount > region.submitCount)
+        return true;
+    if (frame.submitCount < region.submitCount)
+        return false;
+    return m_renderer.m_device.getFenceStatus(*frame.inFlightFence) == vk::Result::eSuccess;
+}
+
+bool StagingRing::waitForOldestRegion() {
+    const auto& region = regions.front();
+    const auto& frame = m_renderer.pResources->frames[region.frameIndex];
+    if (frame.submitCount < region.submitCount)
+        return false;
+    if (frame.submitCount == region.submitCount)
+        m_renderer.m_device.waitForFences(*frame.inFlightFence, VK_TRUE, UINT64_MAX);
+    return true;
+}
+
+vk::DeviceSize StagingRing::getUsed() const {
+    if (head >= tail)
+        return head - tail;
+    return capacity - tail + head;
+}
+
+vk::DeviceSize StagingRing::getCapacity() const {
+    return capacity;
+}
+
+StagingRing::Stats StagingRing::getStats() const {
+    return stats;
+}
+
+void StagingRing::printStats() const {
+    std::cout << "staging ring: peak " << stats.peakUsed / 1024 << " / " << stats.capacity / 1024 << " KiB, "
+              << stats.allocations << " allocations, " << stats.wraps << " wraps, " << stats.stalls << " stalls, "
+              << stats.failures << " failures\n";
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "commonIncludes.h"
+#include "vma/vk_mem_alloc.h"
+#include <deque>
+
+class Renderer;
+// one big persistently mapped staging buffer handed out linearly for runtime
+// uploads, everything allocated before a frame is submitted belongs to that
+// frame and is reclaimed once the frame's fence has signaled
+class StagingRing {
+  public:
+    struct Allocation {
+        vk::Buffer buffer{};
+        vk::DeviceSize offset{};
+        void* ptr{nullptr};
+    };
+
+    struct Stats {
+        vk::DeviceSize capacity{};
+        vk::DeviceSize used{};
+        vk::DeviceSize peakUsed{};
+        uint64_t allocations{};
+        uint64_t wraps{};
+        // how often an allocation had to wait on the gpu to free up space
+        uint64_t stalls{};
+        // allocations that could not fit even after waiting for every frame
+        uint64_t failures{};
+    };
+
+    StagingRing(Renderer& renderer, vk::DeviceSize capacity);
+    ~StagingRing();
+    StagingRing(const StagingRing&) = delete;
+    StagingRing& operator=(const StagingRing&) = delete;
+
+    // returns false when the request can never fit, the caller has to stage it elsewhere
+    bool allocate(vk::DeviceSize size, vk::DeviceSize alignment, Allocation& allocation);
+    void flush(vk::DeviceSize offset, vk::DeviceSize size);
+    // has to be called right before the frame's command buffer is submitted and
+    // after every upload batch that staged from the ring, the frame's fence only
+    // covers work that was submitted before it
+    void closeFrame(uint32_t frameIndex);
+    // releases the space of every frame the gpu is done with, never waits
+    void reclaim();
+    vk::DeviceSize getCapacity() const;
+    Stats getStats() const;
+    void printStats() const;
+
+  private:
+    struct Region {
+        vk::DeviceSize end{};
+        uint32_t frameIndex{};
+        uint64_t submitCount{};
+    };
+
+    Renderer& m_renderer;
+    vk::raii::Buffer buffer{nullptr};
+    VmaAllocation allocation{nullptr};
+    void* mappedPtr{nullptr};
+    vk::DeviceSize capacity{};
+    vk::DeviceSize head{};
+    vk::DeviceSize tail{};
+    vk::DeviceSize closedHead{};
+    std::deque<Region> regions{};
+    Stats stats{};
+
+    bool tryAllocate(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset);
+    bool isRegionFinished(const Region& region);
+    bool waitForOldestRegion();
+    vk::DeviceSize getUsed() const;
+};
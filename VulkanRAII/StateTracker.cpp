@@ -0,0 +1,136 @@
+#include "StateTracker.h"
+
+StateTracker::State StateTracker::getState(Usage usage) {
+    using Stage = vk::PipelineStageFlagBits2;
+    using Access = vk::AccessFlagBits2;
+    switch (usage) {
+    case Usage::Undefined:
+        return {};
+    case Usage::TransferSrc:
+        return {vk::ImageLayout::eTransferSrcOptimal, Stage::eTransfer, Access::eTransferRead};
+    case Usage::TransferDst:
+        return {vk::ImageLayout::eTransferDstOptimal, Stage::eTransfer, Access::eTransferWrite};
+    case Usage::ColorAttachment:
+        return {vk::ImageLayout::eColorAttachmentOptimal, Stage::eColorAttachmentOutput, Access::eColorAttachmentRead | Access::eColorAttachmentWrite};
+    case Usage::DepthAttachment:
+        return {vk::ImageLayout::eDepthAttachmentOptimal, Stage::eEarlyFragmentTests | Stage::eLateFragmentTests, Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite};
+    case Usage::FragmentShaderRead:
+        return {vk::ImageLayout::eShaderReadOnlyOptimal, Stage::eFragmentShader, Access::eShaderSampledRead};
+    case Usage::ComputeShaderWrite:
+        return {vk::ImageLayout::eGeneral, Stage::eComputeShader, Access::eShaderStorageRead | Access::eShaderStorageWrite};
+    case Usage::Present:
+        // the semaphore signaled by the submit covers everything before it
+        return {vk::ImageLayout::ePresentSrcKHR, Stage::eNone, Access::eNone};
+    }
+    throw std::invalid_argument("unknown image usage");
+}
+
+bool StateTracker::isWrite(vk::AccessFlags2 access) {
+    using Access = vk::AccessFlagBits2;
+    const vk::AccessFlags2 writes{Access::eShaderWrite | Access::eShaderStorageWrite | Access::eColorAttachmentWrite | Access::eDepthStencilAttachmentWrite | Access::eTransferWrite | Access::eHostWrite | Access::eMemoryWrite};
+    return static_cast<bool>(access & writes);
+}
+
+void StateTracker::registerImage(vk::Image image, vk::ImageAspectFlags aspect, uint32_t mipLevels, uint32_t layerCount) {
+    TrackedImage tracked{};
+    tracked.aspect = aspect;
+    tracked.mipLevels = mipLevels;
+    tracked.layerCount = layerCount;
+    tracked.states.resize(static_cast<size_t>(mipLevels) * layerCount);
+    images[static_cast<VkImage>(image)] = std::move(tracked);
+}
+
+void StateTracker::assume(vk::Image image, const State& state) {
+    auto it = images.find(static_cast<VkImage>(image));
+    if (it == images.end())
+        throw std::invalid_argument("image is not tracked");
+    std::fill(it->second.states.begin(), it->second.states.end(), state);
+}
+
+const StateTracker::State& StateTracker::getImageState(vk::Image image, uint32_t mipLevel, uint32_t arrayLayer) const {
+    auto it = images.find(static_cast<VkImage>(image));
+    if (it == images.end())
+        throw std::invalid_argument("image is not tracked");
+    return it->second.states.at(static_cast<size_t>(mipLevel) * it->second.layerCount + arrayLayer);
+}
+
+void StateTracker::use(vk::Image image, Usage usage, bool discard, uint32_t baseMipLevel, uint32_t levelCount, uint32_t baseArrayLayer, uint32_t layerCount) {
+    auto it = images.find(static_cast<VkImage>(image));
+    if (it == images.end())
+        throw std::invalid_argument("image is not tracked");
+    auto& tracked = it->second;
+    if (levelCount == VK_REMAINING_MIP_LEVELS)
+        levelCount = tracked.mipLevels - baseMipLevel;
+    if (layerCount == VK_REMAINING_ARRAY_LAYERS)
+        layerCount = tracked.layerCount - baseArrayLayer;
+    if (baseMipLevel + levelCount > tracked.mipLevels || baseArrayLayer + layerCount > tracked.layerCount)
+        throw std::out_of_range("subresource range is outside of the image");
+
+    const State after{getState(usage)};
+    for (uint32_t mipLevel{baseMipLevel}; mipLevel < baseMipLevel + levelCount; mipLevel++) {
+        // layers that share their previous state go out as one barrier
+        uint32_t runStart{baseArrayLayer};
+        State runState{};
+        bool inRun{false};
+        for (uint32_t layer{baseArrayLayer}; layer < baseArrayLayer + layerCount; layer++) {
+            auto& state = tracked.states[static_cast<size_t>(mipLevel) * tracked.layerCount + layer];
+            // reads of a layout that is already in place only need to be remembered
+            // so a later write waits for them
+            if (!discard && state.layout == after.layout && !isWrite(state.access) && !isWrite(after.access)) {
+                if (inRun)
+                    queueBarrier(image, tracked, runState, after, discard, mipLevel, runStart, layer - runStart);
+                inRun = false;
+                state.stages |= after.stages;
+                state.access |= after.access;
+                continue;
+            }
+            if (inRun && state != runState) {
+                queueBarrier(image, tracked, runState, after, discard, mipLevel, runStart, layer - runStart);
+                inRun = false;
+            }
+            if (!inRun) {
+                runStart = layer;
+                runState = state;
+                inRun = true;
+            }
+            state = after;
+        }
+        if (inRun)
+            queueBarrier(image, tracked, runState, after, discard, mipLevel, runStart, baseArrayLayer + layerCount - runStart);
+    }
+}
+
+void StateTracker::queueBarrier(vk::Image image, const TrackedImage& tracked, const State& before, const State& after, bool discard, uint32_t mipLevel, uint32_t baseArrayLayer, uint32_t layerCount) {
+    vk::ImageMemoryBarrier2 barrier{};
+    barrier.srcStageMask = before.stages;
+    // only writes have to be made available, after reads an execution dependency is enough
+    barrier.srcAccessMask = before.access & ~vk::AccessFlags2{vk::AccessFlagBits2::eShaderSampledRead | vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eTransferRead};
+    barrier.dstStageMask = after.stages;
+    barrier.dstAccessMask = after.access;
+    barrier.oldLayout = discard ? vk::ImageLayout::eUndefined : before.layout;
+    barrier.newLayout = after.layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = vk::ImageSubresourceRange{tracked.aspect, mipLevel, 1, baseArrayLayer, layerCount};
+
+    // the same layers of the next mip level with the same history extend the previous barrier
+    if (!pendingBarriers.empty()) {
+        auto& last = pendingBarriers.back();
+        if (last.image == barrier.image && last.srcStageMask == barrier.srcStageMask && last.srcAccessMask == barrier.srcAccessMask && last.dstStageMask == barrier.dstStageMask && last.dstAccessMask == barrier.dstAccessMask && last.oldLayout == barrier.oldLayout && last.newLayout == barrier.newLayout && last.subresourceRange.baseArrayLayer == baseArrayLayer && last.subresourceRange.layerCount == layerCount && last.subresourceRange.baseMipLevel + last.subresourceRange.levelCount == mipLevel) {
+            last.subresourceRange.levelCount++;
+            return;
+        }
+    }
+    pendingBarriers.push_back(barrier);
+}
+
+void StateTracker::flush(const vk::raii::CommandBuffer& commandBuffer) {
+    if (pendingBarriers.empty())
+        return;
+    vk::DependencyInfo dependencyInfo{};
+    dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(pendingBarriers.size());
+    dependencyInfo.pImageMemoryBarriers = pendingBarriers.data();
+    commandBuffer.pipelineBarrier2(dependencyInfo);
+    pendingBarriers.clear();
+}
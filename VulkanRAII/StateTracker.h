@@ -0,0 +1,55 @@
+#pragma once
+#include "commonIncludes.h"
+#include <unordered_map>
+
+// remembers the layout, stages and accesses every subresource of the tracked
+// images was last used with, callers only say how they are about to use a
+// range and the tracker works out the barrier, the queued barriers are then
+// recorded together with a single pipelineBarrier2
+class StateTracker {
+  public:
+    enum class Usage {
+        Undefined,
+        TransferSrc,
+        TransferDst,
+        ColorAttachment,
+        DepthAttachment,
+        FragmentShaderRead,
+        ComputeShaderWrite,
+        Present
+    };
+
+    struct State {
+        vk::ImageLayout layout{vk::ImageLayout::eUndefined};
+        vk::PipelineStageFlags2 stages{};
+        vk::AccessFlags2 access{};
+        bool operator==(const State&) const = default;
+    };
+
+    static State getState(Usage usage);
+    // has to be called again whenever the image is recreated, the old state is dropped
+    void registerImage(vk::Image image, vk::ImageAspectFlags aspect, uint32_t mipLevels = 1, uint32_t layerCount = 1);
+    // overwrites the state without a barrier, for hand offs that are synchronized
+    // some other way such as a swapchain image coming back from the presentation engine
+    void assume(vk::Image image, const State& state);
+    const State& getImageState(vk::Image image, uint32_t mipLevel = 0, uint32_t arrayLayer = 0) const;
+    // discard means the current contents are not needed and the layout can start
+    // from undefined, a subresource may only be used once between two flushes
+    void use(vk::Image image, Usage usage, bool discard = false, uint32_t baseMipLevel = 0, uint32_t levelCount = VK_REMAINING_MIP_LEVELS, uint32_t baseArrayLayer = 0, uint32_t layerCount = VK_REMAINING_ARRAY_LAYERS);
+    void flush(const vk::raii::CommandBuffer& commandBuffer);
+
+  private:
+    struct TrackedImage {
+        vk::ImageAspectFlags aspect{};
+        uint32_t mipLevels{};
+        uint32_t layerCount{};
+        // indexed by mip level * layerCount + layer
+        std::vector<State> states{};
+    };
+
+    std::unordered_map<VkImage, TrackedImage> images{};
+    std::vector<vk::ImageMemoryBarrier2> pendingBarriers{};
+
+    static bool isWrite(vk::AccessFlags2 access);
+    void queueBarrier(vk::Image image, const TrackedImage& tracked, const State& before, const State& after, bool discard, uint32_t mipLevel, uint32_t baseArrayLayer, uint32_t layerCount);
+};
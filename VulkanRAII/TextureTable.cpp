@@ -0,0 +1,107 @@
+#include "TextureTable.h"
+#include "Renderer.h"
+
+TextureTable::TextureTable(Renderer& renderer, uint32_t requestedCapacity)
+    : m_renderer{renderer} {
+    if (!m_renderer.descriptorIndexing)
+        throw std::runtime_error("the texture table needs the descriptor indexing features");
+
+    auto properties = m_renderer.m_physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>();
+    const auto& limits = properties.get<vk::PhysicalDeviceVulkan12Properties>();
+    // a combined image sampler counts as a sampled image and as a sampler, and the
+    // per stage resource limit also covers the rest of the scene's fragment stage,
+    // which is only its color attachment
+    const uint32_t otherFragmentResources{1};
+    capacity = std::min({requestedCapacity,
+        limits.maxDescriptorSetUpdateAfterBindSampledImages, limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        limits.maxDescriptorSetUpdateAfterBindSamplers, limits.maxPerStageDescriptorUpdateAfterBindSamplers,
+        limits.maxPerStageUpdateAfterBindResources - otherFragmentResources});
+
+    // partially bound so unused slots can stay empty, the count is only fixed
+    // when the set is allocated
+    vk::DescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorCount = capacity;
+    binding.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+    binding.stageFlags = vk::ShaderStageFlagBits::eFragment;
+    binding.pImmutableSamplers = nullptr;
+
+    vk::DescriptorBindingFlags bindingFlags{vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eVariableDescriptorCount};
+    vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.bindingCount = 1;
+    bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+    layout = m_renderer.m_device.createDescriptorSetLayout(layoutInfo);
+
+    vk::DescriptorPoolSize poolSize{};
+    poolSize.type = vk::DescriptorType::eCombinedImageSampler;
+    poolSize.descriptorCount = capacity;
+
+    vk::DescriptorPoolCreateInfo poolInfo{};
+    poolInfo.flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind | vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    pool = m_renderer.m_device.createDescriptorPool(poolInfo);
+
+    vk::DescriptorSetVariableDescriptorCountAllocateInfo variableCountInfo{};
+    variableCountInfo.descriptorSetCount = 1;
+    variableCountInfo.pDescriptorCounts = &capacity;
+
+    vk::DescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.pNext = &variableCountInfo;
+    allocateInfo.descriptorPool = *pool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &(*layout);
+    auto descriptorSets = m_renderer.m_device.allocateDescriptorSets(allocateInfo);
+    descriptorSet = std::move(descriptorSets[0]);
+}
+
+uint32_t TextureTable::registerTexture(vk::ImageView imageView, vk::Sampler sampler) {
+    uint32_t index{};
+    if (!freeIndices.empty()) {
+        index = freeIndices.back();
+        freeIndices.pop_back();
+    } else {
+        if (nextIndex == capacity)
+            throw std::runtime_error("texture table is full");
+        index = nextIndex++;
+    }
+
+    vk::DescriptorImageInfo imageInfo{};
+    imageInfo.imageView = imageView;
+    imageInfo.sampler = sampler;
+    imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+    vk::WriteDescriptorSet descriptorWrite{};
+    descriptorWrite.dstSet = *descriptorSet;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = index;
+    descriptorWrite.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+    m_renderer.m_device.updateDescriptorSets(descriptorWrite, nullptr);
+    return index;
+}
+
+void TextureTable::unregisterTexture(uint32_t index) {
+    // partially bound means a stale slot is fine as long as nothing samples it
+    freeIndices.push_back(index);
+}
+
+const vk::raii::DescriptorSetLayout& TextureTable::getLayout() const {
+    return layout;
+}
+
+const vk::raii::DescriptorSet& TextureTable::getDescriptorSet() const {
+    return descriptorSet;
+}
+
+uint32_t TextureTable::getCapacity() const {
+    return capacity;
+}
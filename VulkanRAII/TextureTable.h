@@ -0,0 +1,31 @@
+#pragma once
+#include "commonIncludes.h"
+
+class Renderer;
+// one descriptor set holding every sampled texture in a single variable sized
+// array, a texture registers once and is afterwards only referred to by its
+// index so adding materials never touches the per-frame descriptor sets
+class TextureTable {
+  public:
+    TextureTable(Renderer& renderer, uint32_t requestedCapacity = 4096);
+    TextureTable(const TextureTable&) = delete;
+    TextureTable& operator=(const TextureTable&) = delete;
+
+    // the slot is written right away, update after bind lets this happen
+    // while the set is bound in frames the gpu is still working on
+    uint32_t registerTexture(vk::ImageView imageView, vk::Sampler sampler);
+    // the gpu has to be done with every frame that used the index
+    void unregisterTexture(uint32_t index);
+    const vk::raii::DescriptorSetLayout& getLayout() const;
+    const vk::raii::DescriptorSet& getDescriptorSet() const;
+    uint32_t getCapacity() const;
+
+  private:
+    Renderer& m_renderer;
+    uint32_t capacity{};
+    uint32_t nextIndex{};
+    std::vector<uint32_t> freeIndices{};
+    vk::raii::DescriptorSetLayout layout{nullptr};
+    vk::raii::DescriptorPool pool{nullptr};
+    vk::raii::DescriptorSet descriptorSet{nullptr};
+};
@@ -0,0 +1,39 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    // hardware_concurrency is allowed to return 0 when it can't tell
+    threadCount = std::max<uint32_t>(threadCount, 1);
+    for (uint32_t index{}; index < threadCount; index++)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock{queueMutex};
+        stopping = true;
+    }
+    queueCondition.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+uint32_t ThreadPool::getThreadCount() const {
+    return static_cast<uint32_t>(workers.size());
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task{};
+        {
+            std::unique_lock lock{queueMutex};
+            queueCondition.wait(lock, [this] { return stopping || !tasks.empty(); });
+            // queued tasks still run so nobody is left waiting on a future
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
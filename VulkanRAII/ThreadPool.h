@@ -0,0 +1,44 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// a plain fixed size pool, tasks run in submission order on whichever worker
+// is free and their result or exception comes back through the future
+class ThreadPool {
+  public:
+    ThreadPool(uint32_t threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename Task>
+    auto submit(Task&& task) -> std::future<std::invoke_result_t<std::decay_t<Task>>> {
+        using Result = std::invoke_result_t<std::decay_t<Task>>;
+        // packaged_task is move only but std::function wants something copyable
+        auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+        auto future = packagedTask->get_future();
+        {
+            std::lock_guard lock{queueMutex};
+            tasks.emplace_back([packagedTask] { (*packagedTask)(); });
+        }
+        queueCondition.notify_one();
+        return future;
+    }
+
+    uint32_t getThreadCount() const;
+
+  private:
+    std::vector<std::thread> workers{};
+    std::deque<std::function<void()>> tasks{};
+    std::mutex queueMutex{};
+    std::condition_variable queueCondition{};
+    bool stopping{false};
+
+    void workerLoop();
+};
@@ -0,0 +1,136 @@
+#include "UploadBatch.h"
+#include "Renderer.h"
+#include "Resources.h"
+
+UploadBatch::UploadBatch(Renderer& renderer, StagingRing* ring)
+    : m_renderer{renderer}
+    , ring{ring} {
+    commandBuffer = m_renderer.pResources->createSingleTimeCB();
+    fence = m_renderer.m_device.createFence(vk::FenceCreateInfo{});
+
+    vk::CommandBufferBeginInfo beginInfo{};
+    beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+    commandBuffer.begin(beginInfo);
+    recording = true;
+}
+
+UploadBatch::~UploadBatch() {
+    if (submitted)
+        wait();
+    releaseStaging();
+}
+
+UploadBatch::StagingRange UploadBatch::stage(vk::DeviceSize size, vk::DeviceSize alignment) {
+    if (!recording)
+        throw std::runtime_error("staging into an upload batch that was already submitted");
+
+    StagingRing::Allocation ringAllocation{};
+    if (ring && ring->allocate(size, alignment, ringAllocation)) {
+        ringRanges.emplace_back(ringAllocation.offset, size);
+        empty = false;
+        return StagingRange{ringAllocation.buffer, ringAllocation.offset, ringAllocation.ptr};
+    }
+
+    auto alignUp = [alignment](vk::DeviceSize value) {
+        return (value + alignment - 1) / alignment * alignment;
+    };
+
+    // only the newest chunk is ever bumped, older ones are full enough
+    if (chunks.empty() || alignUp(chunks.back().used) + size > chunks.back().size) {
+        StagingChunk chunk{};
+        chunk.size = std::max(chunkSize, size);
+        chunk.buffer = m_renderer.pResources->createBuffer(vk::BufferUsageFlagBits::eTransferSrc, chunk.size, VmaAllocationCreateFlagBits::VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, 0, chunk.allocation, MemoryTelemetry::Category::Staging);
+        chunk.ptr = m_renderer.pResources->mapPersistentMemory(m_renderer.allocator, chunk.allocation, chunk.size);
+        chunks.push_back(std::move(chunk));
+    }
+
+    auto& chunk = chunks.back();
+    StagingRange range{};
+    range.buffer = *chunk.buffer;
+    range.offset = alignUp(chunk.used);
+    range.ptr = static_cast<char*>(chunk.ptr) + range.offset;
+    chunk.used = range.offset + size;
+    empty = false;
+    return range;
+}
+
+UploadBatch::StagingRange UploadBatch::stage(const void* src, vk::DeviceSize size, vk::DeviceSize alignment) {
+    auto range = stage(size, alignment);
+    std::memcpy(range.ptr, src, size);
+    return range;
+}
+
+void UploadBatch::copyToBuffer(const void* src, vk::DeviceSize size, vk::Buffer dstBuffer, vk::DeviceSize dstOffset) {
+    auto range = stage(src, size);
+
+    vk::BufferCopy copyRegion{};
+    copyRegion.size = size;
+    copyRegion.srcOffset = range.offset;
+    copyRegion.dstOffset = dstOffset;
+    commandBuffer.copyBuffer(range.buffer, dstBuffer, copyRegion);
+}
+
+vk::raii::CommandBuffer& UploadBatch::getCommandBuffer() {
+    return commandBuffer;
+}
+
+bool UploadBatch::isEmpty() const {
+    return empty;
+}
+
+void UploadBatch::submit() {
+    if (!recording)
+        return;
+
+    for (const auto& chunk : chunks)
+        if (vmaFlushAllocation(m_renderer.allocator, chunk.allocation, 0, chunk.used) != VK_SUCCESS)
+            throw std::runtime_error("vma flush failed");
+    for (const auto& [offset, size] : ringRanges)
+        ring->flush(offset, size);
+
+    // one barrier makes every buffer copy of the batch visible to whatever
+    // reads it later, images do their own layout transitions
+    vk::MemoryBarrier barrier{};
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader,
+        {}, barrier, nullptr, nullptr);
+    commandBuffer.end();
+    recording = false;
+
+    vk::SubmitInfo submitInfo{};
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &*commandBuffer;
+    m_renderer.m_queue.submit(submitInfo, *fence);
+    submitted = true;
+}
+
+bool UploadBatch::isComplete() {
+    if (!submitted)
+        return false;
+    if (completed)
+        return true;
+    if (m_renderer.m_device.getFenceStatus(*fence) != vk::Result::eSuccess)
+        return false;
+    releaseStaging();
+    completed = true;
+    return true;
+}
+
+void UploadBatch::wait() {
+    if (!submitted || completed)
+        return;
+    m_renderer.m_device.waitForFences(*fence, VK_TRUE, UINT64_MAX);
+    releaseStaging();
+    completed = true;
+}
+
+void UploadBatch::releaseStaging() {
+    for (auto& chunk : chunks) {
+        chunk.buffer.clear();
+        vmaUnmapMemory(m_renderer.allocator, chunk.allocation);
+        m_renderer.memoryTelemetry.free(chunk.allocation);
+    }
+    chunks.clear();
+}
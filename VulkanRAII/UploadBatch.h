@@ -0,0 +1,61 @@
+#pragma once
+#include "commonIncludes.h"
+#include "vma/vk_mem_alloc.h"
+#include "StagingRing.h"
+
+class Renderer;
+// collects any number of buffer and image uploads into one command buffer
+// backed by a linear staging arena, the whole batch is submitted once and the
+// staging memory is released when its fence has signaled
+class UploadBatch {
+  public:
+    struct StagingRange {
+        vk::Buffer buffer{};
+        vk::DeviceSize offset{};
+        void* ptr{nullptr};
+    };
+
+    // with a ring the staging memory comes out of it and is reclaimed per frame,
+    // without one the batch allocates its own chunks
+    UploadBatch(Renderer& renderer, StagingRing* ring = nullptr);
+    ~UploadBatch();
+    UploadBatch(const UploadBatch&) = delete;
+    UploadBatch& operator=(const UploadBatch&) = delete;
+
+    // reserves size bytes of staging memory, the caller writes through ptr and
+    // records its copies from buffer at offset into getCommandBuffer()
+    StagingRange stage(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+    StagingRange stage(const void* src, vk::DeviceSize size, vk::DeviceSize alignment = 16);
+    void copyToBuffer(const void* src, vk::DeviceSize size, vk::Buffer dstBuffer, vk::DeviceSize dstOffset = 0);
+    vk::raii::CommandBuffer& getCommandBuffer();
+    bool isEmpty() const;
+
+    void submit();
+    // true once the gpu has finished the batch, frees the staging memory the first time
+    bool isComplete();
+    void wait();
+
+  private:
+    struct StagingChunk {
+        vk::raii::Buffer buffer{nullptr};
+        VmaAllocation allocation{nullptr};
+        void* ptr{nullptr};
+        vk::DeviceSize size{};
+        vk::DeviceSize used{};
+    };
+
+    static constexpr vk::DeviceSize chunkSize{32 * 1024 * 1024};
+
+    Renderer& m_renderer;
+    StagingRing* ring{nullptr};
+    std::vector<std::pair<vk::DeviceSize, vk::DeviceSize>> ringRanges{};
+    vk::raii::CommandBuffer commandBuffer{nullptr};
+    vk::raii::Fence fence{nullptr};
+    std::vector<StagingChunk> chunks{};
+    bool recording{false};
+    bool submitted{false};
+    bool completed{false};
+    bool empty{true};
+
+    void releaseStaging();
+};
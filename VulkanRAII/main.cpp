@@ -3,13 +3,14 @@
 #include "Graphics.h"
 #include "Resources.h"
 
-int main() {
-    std::vector<std::string> args{};
-    Renderer app{args};
-    PresentationEngine engine{app};
-    Graphics graphics{app};
-    Resources resources{app};
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args{argv + 1, argv + argc};
     try {
+        // the constructor parses the options and throws on bad values
+        Renderer app{args};
+        PresentationEngine engine{app};
+        Graphics graphics{app};
+        Resources resources{app};
         app.run(&engine, &graphics, &resources);
     } catch (const std::exception& except) {
         std::cout << except.what();
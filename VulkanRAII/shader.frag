@@ -1,4 +1,5 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 texCoord;
@@ -10,8 +11,9 @@ layout( push_constant ) uniform constants
     int index;
 } PushConstants;
 
-layout(binding = 1) uniform sampler2D texSampler[3];
+// the whole texture table, index is the slot the texture was registered at
+layout(set = 1, binding = 0) uniform sampler2D textures[];
 
 void main() {
-    outColor = texture(texSampler[1], texCoord);
+    outColor = texture(textures[PushConstants.index], texCoord);
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 C:\VulkanSDK\1.3.275.0\Bin/glslc.exe shader.vert -o vertex.spv
+C:\VulkanSDK\1.3.275.0\Bin/glslc.exe shader_compact.vert -o vertexCompact.spv
 C:\VulkanSDK\1.3.275.0\Bin/glslc.exe shader.frag -o fragment.spv
 C:\VulkanSDK\1.3.275.0\Bin/glslc.exe shader.comp -o comp.spv
+C:\VulkanSDK\1.3.275.0\Bin/glslc.exe cull.comp -o cull.spv
 C:\VulkanSDK\1.3.275.0\Bin/glslc.exe skybox.vert -o skyVert.spv
 C:\VulkanSDK\1.3.275.0\Bin/glslc.exe skybox.frag -o skyFrag.spv
 pause
\ No newline at end of file